@@ -8,3 +8,18 @@ cd ros_ws/src/crazyswarm/scripts/pycrazyswarm/cfsim
 make
 cd $ROOT
 
+# build batch simulation of the planners
+cd ros_ws/src/crazyswarm/scripts/pycrazyswarm/swarmsim
+make
+cd $ROOT
+
+# build host-side NN inference
+cd ros_ws/src/crazyswarm/scripts/pycrazyswarm/nnsim
+make
+cd $ROOT
+
+# build batched trajectory evaluation
+cd ros_ws/src/crazyswarm/scripts/pycrazyswarm/ppbatch
+make
+cd $ROOT
+
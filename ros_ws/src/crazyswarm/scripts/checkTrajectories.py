@@ -0,0 +1,149 @@
+#!/usr/bin/env python
+
+# Checks trajectories (csv files as written by the trajectory generation) before they are flown.
+#
+#   checkTrajectories.py benchmark figure8.csv --cfs 100 --samples 6000 --derivatives 2
+#       compares the batched evaluation (src/piecewise_batch.h, pycrazyswarm.ppbatch) with the
+#       firmware's piecewise_eval, called for one CF and one time at a time (pycrazyswarm.cfsim)
+#   checkTrajectories.py feasibility cf*.csv --timescale 1.0
+#       checks each trajectory against the dynamics limits (src/trajectory_feasibility.h), like
+#       upload_trajectory of the server, and reports the first violation and the fastest
+#       feasible timescale
+#   checkTrajectories.py collisions cf*.csv --crazyflies ../launch/crazyflies.yaml
+#       reports the pairs of CFs that come closer than the downwash ellipsoid while flying the
+#       trajectories at the same time (src/collision_checker.h); with --crazyflies, the trajectories
+#       are relative to the initialPosition of the CFs in the same order
+
+import argparse
+import time
+import numpy as np
+import yaml
+
+import uav_trajectory
+from pycrazyswarm import ppbatch
+
+def loadPieces(fileName):
+    trajectory = uav_trajectory.Trajectory()
+    trajectory.loadcsv(fileName)
+    return ppbatch.pieces(trajectory)
+
+def firmwareTrajectory(firm, pieces):
+    traj = firm.piecewise_traj()
+    traj.t_begin = 0
+    traj.timescale = 1.0
+    traj.shift = firm.mkvec(0, 0, 0)
+    traj.n_pieces = len(pieces)
+    traj.pieces = firm.malloc_poly4d(len(pieces))
+    for i, row in enumerate(pieces):
+        piece = firm.pp_get_piece(traj, i)
+        piece.duration = float(row[0])
+        for axis in range(4):
+            for coef in range(8):
+                firm.poly4d_set(piece, axis, coef, float(row[1 + 8 * axis + coef]))
+    return traj
+
+def benchmark(args):
+    from pycrazyswarm.cfsim import cffirmware as firm
+    pieces = loadPieces(args.trajectory)
+    trajectories = ppbatch.Trajectories(args.threads)
+    for i in range(args.cfs):
+        trajectories.add(pieces, shift = (i, 0, 0))
+    times = np.linspace(0, trajectories.duration(0), args.samples)
+
+    start = time.time()
+    result = trajectories.evaluate(times, args.derivatives)
+    batchTime = time.time() - start
+
+    traj = firmwareTrajectory(firm, pieces)
+    maxError = 0.0
+    start = time.time()
+    for i in range(args.cfs):
+        traj.shift = firm.mkvec(i, 0, 0)
+        for k, t in enumerate(times):
+            ev = firm.piecewise_eval(traj, float(t))
+            maxError = max(maxError,
+                abs(ev.pos.x - result[i, 0, 0, k]), abs(ev.pos.y - result[i, 0, 1, k]), abs(ev.pos.z - result[i, 0, 2, k]))
+    scalarTime = time.time() - start
+
+    n = args.cfs * args.samples
+    print("{} CFs x {} samples, {} derivatives".format(args.cfs, args.samples, args.derivatives))
+    print("batch:  {:8.3f} s ({:.3g} evaluations/s)".format(batchTime, n / batchTime))
+    print("scalar: {:8.3f} s ({:.3g} evaluations/s, positions only)".format(scalarTime, n / scalarTime))
+    print("max. position difference: {:.3g} m".format(maxError))
+
+def feasibility(args):
+    with open(args.types, 'r') as ymlfile:
+        dynamics = yaml.load(ymlfile)["dynamicsConfigurations"][args.dynamics]
+    limits = ppbatch.limits(dynamics, args.thrust_to_weight, args.max_thrust)
+    trajectories = ppbatch.Trajectories(args.threads)
+    for fileName in args.trajectories:
+        trajectories.add(loadPieces(fileName), args.timescale)
+
+    start = time.time()
+    results = trajectories.checkFeasibility(limits, args.sample_time)
+    elapsed = time.time() - start
+
+    for fileName, result in zip(args.trajectories, results):
+        print("{}: {} {}".format(fileName, "feasible" if result.feasible() else "NOT feasible", result.describe()))
+    print("checked {} trajectories in {:.3f} s, {} not feasible".format(
+        len(results), elapsed, sum(not result.feasible() for result in results)))
+
+def collisions(args):
+    shifts = [(0, 0, 0)] * len(args.trajectories)
+    if args.crazyflies:
+        with open(args.crazyflies, 'r') as ymlfile:
+            crazyflies = yaml.load(ymlfile)["crazyflies"]
+        if len(crazyflies) < len(args.trajectories):
+            raise ValueError("{} has fewer CFs than trajectories".format(args.crazyflies))
+        shifts = [crazyflie["initialPosition"] for crazyflie in crazyflies]
+    trajectories = ppbatch.Trajectories(args.threads)
+    for fileName, shift in zip(args.trajectories, shifts):
+        pieces = loadPieces(fileName)
+        if args.crazyflies:
+            # like startTrajectory(relative = True): the first position moves to the CF
+            shift = np.array(shift) - pieces[0, [1, 9, 17]]
+        trajectories.add(pieces, args.timescale, shift)
+
+    start = time.time()
+    result = trajectories.checkCollisions(args.radius_xy, args.radius_z, args.sample_time)
+    elapsed = time.time() - start
+
+    for collision in result:
+        print("{} - {}: {:.2f} s to {:.2f} s, closest at {:.2f} s (ellipsoidal distance {:.2f})".format(
+            args.trajectories[collision.first], args.trajectories[collision.second],
+            collision.start, collision.end, collision.time, collision.distance))
+    print("checked {} trajectories in {:.3f} s, {} collisions".format(len(args.trajectories), elapsed, len(result)))
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--threads", type=int, default=0, help="0: all cores")
+    subparsers = parser.add_subparsers(dest="command")
+
+    p = subparsers.add_parser("benchmark")
+    p.add_argument("trajectory")
+    p.add_argument("--cfs", type=int, default=100)
+    p.add_argument("--samples", type=int, default=6000)
+    p.add_argument("--derivatives", type=int, default=2, help="up to 4 (snap)")
+    p.set_defaults(func=benchmark)
+
+    p = subparsers.add_parser("feasibility")
+    p.add_argument("trajectories", nargs="+")
+    p.add_argument("--timescale", type=float, default=1.0)
+    p.add_argument("--types", default="../launch/crazyflieTypes.yaml", help="with dynamicsConfigurations")
+    p.add_argument("--dynamics", default="0", help="entry of dynamicsConfigurations")
+    p.add_argument("--thrust-to-weight", type=float, default=1.9, help="at ctrlNN.max_thrust = 1")
+    p.add_argument("--max-thrust", type=float, default=1.0, help="ctrlNN.max_thrust")
+    p.add_argument("--sample-time", type=float, default=0.01)
+    p.set_defaults(func=feasibility)
+
+    p = subparsers.add_parser("collisions")
+    p.add_argument("trajectories", nargs="+")
+    p.add_argument("--crazyflies", help="crazyflies.yaml, to start each trajectory at the initialPosition")
+    p.add_argument("--timescale", type=float, default=1.0)
+    p.add_argument("--radius-xy", type=float, default=0.12, help="m, min. distance in x/y")
+    p.add_argument("--radius-z", type=float, default=0.3, help="m, min. distance in z (downwash)")
+    p.add_argument("--sample-time", type=float, default=0.01)
+    p.set_defaults(func=collisions)
+
+    args = parser.parse_args()
+    args.func(args)
@@ -0,0 +1,168 @@
+#!/usr/bin/env python
+
+# Converts a NN controller to the descriptor sent by uploadNN (see src/nn_descriptor.h),
+# with float32, float16 or int8 (per-layer scale) weights, and checks the quantized network.
+#
+# The network is a .npz file with W0, b0, W1, b1, ... (W: inputs x outputs, i.e., y = x W + b);
+# hidden layers use the given activation, the output layer is linear.
+#
+#   nnQuantize.py convert net.npz net_int8.bin --dtype int8
+#   nnQuantize.py validate net.npz logcf1.csv --dtype int8 [--dtype float16]
+#       runs the float and the quantized network on the logged ctrlNN.in* inputs
+#       (all inputs have to be logged) and reports the output error
+#   nnQuantize.py benchmark net.npz --restore current.bin --ids 1 2
+#       uploads each weight type (crazyswarm_server has to run) and reports bytes and time,
+#       then uploads the given descriptor again (the CFs cannot report the NN they had)
+#
+# Only firmware that reports ctrlNN.cfnnVersion decodes these descriptors; the server
+# refuses to upload them to other CFs (see src/nn_descriptor.h).
+
+import argparse
+import os
+import struct
+import sys
+import tempfile
+import numpy as np
+
+DTYPES = {"float32": 0, "float16": 1, "int8": 2}
+ACTIVATIONS = {"relu": 0, "tanh": 1}
+
+def loadNetwork(fileName):
+    data = np.load(fileName)
+    layers = []
+    while "W{}".format(len(layers)) in data:
+        i = len(layers)
+        W = np.asarray(data["W{}".format(i)], dtype=np.float32)
+        b = np.asarray(data["b{}".format(i)], dtype=np.float32).reshape(-1)
+        if layers and layers[-1][0].shape[1] != W.shape[0]:
+            raise ValueError("W{} does not match the previous layer".format(i))
+        layers.append((W, b))
+    if not layers:
+        raise ValueError("{}: no layers (expected W0, b0, ...)".format(fileName))
+    return layers
+
+# Returns the weights as stored, and the per-layer scale
+def quantize(W, dtype):
+    if dtype == "int8":
+        scale = np.max(np.abs(W)) / 127.0
+        if scale == 0:
+            scale = 1.0
+        return np.clip(np.round(W / scale), -127, 127).astype(np.int8), scale
+    if dtype == "float16":
+        return W.astype(np.float16), 1.0
+    return W.astype(np.float32), 1.0
+
+def dequantize(layers, dtype):
+    result = []
+    for W, b in layers:
+        q, scale = quantize(W, dtype)
+        result.append((q.astype(np.float32) * np.float32(scale), b))
+    return result
+
+def encode(layers, dtype, activation):
+    data = bytearray(b"CFNN")
+    data += struct.pack("<BBBB", 1, DTYPES[dtype], len(layers), ACTIVATIONS[activation])
+    for W, b in layers:
+        q, scale = quantize(W, dtype)
+        data += struct.pack("<HHf", W.shape[0], W.shape[1], scale)
+        # outputs x inputs, row major, little endian
+        weights = q.T.astype(q.dtype.newbyteorder("<")).tobytes()
+        data += weights + b"\0" * (-len(weights) % 4)
+        data += b.astype("<f4").tobytes()
+    return bytes(data)
+
+def forward(layers, x, activation):
+    for i, (W, b) in enumerate(layers):
+        x = x.dot(W) + b
+        if i < len(layers) - 1:
+            x = np.maximum(x, 0) if activation == "relu" else np.tanh(x)
+    return x
+
+# ctrlNN.in<k> columns of a logcf<id>.csv written by crazyswarm_server
+def loadInputs(fileName, numInputs):
+    with open(fileName) as f:
+        header = f.readline().strip().strip(",").split(",")
+    columns = []
+    for k in range(numInputs):
+        name = "ctrlNN.in{}".format(k)
+        if name not in header:
+            raise ValueError("{}: {} is not logged (the network has {} inputs)".format(fileName, name, numInputs))
+        columns.append(header.index(name))
+    data = np.genfromtxt(fileName, delimiter=",", skip_header=1, usecols=columns)
+    return np.atleast_2d(data).astype(np.float32)
+
+def convert(args):
+    layers = loadNetwork(args.network)
+    data = encode(layers, args.dtype[0], args.activation)
+    with open(args.output, "wb") as f:
+        f.write(data)
+    floatSize = len(encode(layers, "float32", args.activation))
+    print("{}: {} B ({:.0f} % of float32)".format(args.output, len(data), 100.0 * len(data) / floatSize))
+
+def validate(args):
+    layers = loadNetwork(args.network)
+    x = loadInputs(args.log, layers[0][0].shape[0])
+    reference = forward(layers, x, args.activation)
+    floatSize = len(encode(layers, "float32", args.activation))
+    print("{} samples, {} outputs".format(x.shape[0], reference.shape[1]))
+    for dtype in args.dtype:
+        error = np.abs(forward(dequantize(layers, dtype), x, args.activation) - reference)
+        size = len(encode(layers, dtype, args.activation))
+        print("{:8s} {:7d} B ({:3.0f} %): max. error {:.3g}, mean error {:.3g}, p99 {:.3g} (per output max. {})".format(
+            dtype, size, 100.0 * size / floatSize, np.max(error), np.mean(error),
+            np.percentile(error, 99), np.array2string(np.max(error, axis=0), precision=3)))
+
+def benchmark(args):
+    from pycrazyswarm import crazyflie
+    import rospy
+    layers = loadNetwork(args.network)
+    allcfs = crazyflie.CrazyflieServer()
+    # the server reads the files, so it has to run on this machine
+    restore = os.path.abspath(args.restore)
+    if not os.path.isfile(restore):
+        raise ValueError("{}: no such file".format(restore))
+    try:
+        for dtype in ["float32", "float16", "int8"]:
+            data = encode(layers, dtype, args.activation)
+            with tempfile.NamedTemporaryFile(suffix=".bin", delete=False) as f:
+                f.write(data)
+            try:
+                res = allcfs.uploadNN(f.name, ids=args.ids, force=True)
+            finally:
+                os.remove(f.name)
+            throughput = np.array(res.throughput)
+            times = len(data) / throughput if len(throughput) else np.array([np.nan])
+            print("{:8s} {:7d} B: {} CFs, mean {:.3f} s ({:.0f} B/s), max. {:.3f} s, {} failed".format(
+                dtype, len(data), len(res.uploadedIds), np.mean(times), np.mean(throughput) if len(throughput) else 0,
+                np.max(times), len(res.failedIds)))
+    finally:
+        res = allcfs.uploadNN(restore, ids=args.ids, force=True)
+        print("restored {}: {} CFs, {} failed".format(args.restore, len(res.uploadedIds), len(res.failedIds)))
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--activation", choices=ACTIVATIONS.keys(), default="tanh", help="of the hidden layers")
+    subparsers = parser.add_subparsers(dest="command")
+
+    p = subparsers.add_parser("convert")
+    p.add_argument("network")
+    p.add_argument("output")
+    p.add_argument("--dtype", choices=DTYPES.keys(), action="append")
+    p.set_defaults(func=convert)
+
+    p = subparsers.add_parser("validate")
+    p.add_argument("network")
+    p.add_argument("log", help="logcf<id>.csv with all ctrlNN.in* variables")
+    p.add_argument("--dtype", choices=DTYPES.keys(), action="append")
+    p.set_defaults(func=validate)
+
+    p = subparsers.add_parser("benchmark")
+    p.add_argument("network")
+    p.add_argument("--restore", required=True, help="descriptor to upload afterwards (the NN the CFs fly with)")
+    p.add_argument("--ids", type=int, nargs="*", default=[])
+    p.set_defaults(func=benchmark)
+
+    args = parser.parse_args()
+    if getattr(args, "dtype", None) is None:
+        args.dtype = ["float32"] if args.command == "convert" else ["float16", "int8"]
+    args.func(args)
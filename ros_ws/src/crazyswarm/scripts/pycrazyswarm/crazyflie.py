@@ -10,11 +10,24 @@ import time
 from std_srvs.srv import Empty
 from crazyflie_driver.srv import *
 from crazyflie_driver.msg import TrajectoryPolynomialPiece
+from crazyswarm.srv import QueryTelemetry, AddCrazyflie, RemoveCrazyflie, ReplaceCrazyflie, UploadSwarmTrajectory, StreamTrajectory, UploadSwarmNN
 from tf import TransformListener
 
 def arrayToGeometryPoint(a):
     return geometry_msgs.msg.Point(a[0], a[1], a[2])
 
+def trajectoryToPieces(trajectory):
+    pieces = []
+    for poly in trajectory.polynomials:
+        piece = TrajectoryPolynomialPiece()
+        piece.duration = rospy.Duration.from_sec(poly.duration)
+        piece.poly_x   = poly.px.p
+        piece.poly_y   = poly.py.p
+        piece.poly_z   = poly.pz.p
+        piece.poly_yaw = poly.pyaw.p
+        pieces.append(piece)
+    return pieces
+
 class TimeHelper:
     def __init__(self):
         rospy.wait_for_service("/next_phase")
@@ -75,15 +88,7 @@ class Crazyflie:
         self.goToService(groupMask, relative, gp, yaw, rospy.Duration.from_sec(duration))
 
     def uploadTrajectory(self, trajectoryId, pieceOffset, trajectory):
-        pieces = []
-        for poly in trajectory.polynomials:
-            piece = TrajectoryPolynomialPiece()
-            piece.duration = rospy.Duration.from_sec(poly.duration)
-            piece.poly_x   = poly.px.p
-            piece.poly_y   = poly.py.p
-            piece.poly_z   = poly.pz.p
-            piece.poly_yaw = poly.pyaw.p
-            pieces.append(piece)
+        pieces = trajectoryToPieces(trajectory)
         self.uploadTrajectoryService(trajectoryId, pieceOffset, pieces)
 
     def startTrajectory(self, trajectoryId, timescale = 1.0, reverse = False, relative = True, groupMask = 0):
@@ -125,8 +130,22 @@ class CrazyflieServer:
         # self.goToService = rospy.ServiceProxy("/go_to", GoTo)
         rospy.wait_for_service("/start_trajectory");
         self.startTrajectoryService = rospy.ServiceProxy("/start_trajectory", StartTrajectory)
-        # rospy.wait_for_service("/update_params")
-        # self.updateParamsService = rospy.ServiceProxy("/update_params", UpdateParams)
+        # only available if logging is enabled
+        self.queryTelemetryService = rospy.ServiceProxy("/query_telemetry", QueryTelemetry)
+        rospy.wait_for_service("/update_params")
+        self.updateParamsService = rospy.ServiceProxy("/update_params", UpdateParams)
+        rospy.wait_for_service("/add_crazyflie")
+        self.addCrazyflieService = rospy.ServiceProxy("/add_crazyflie", AddCrazyflie)
+        rospy.wait_for_service("/remove_crazyflie")
+        self.removeCrazyflieService = rospy.ServiceProxy("/remove_crazyflie", RemoveCrazyflie)
+        rospy.wait_for_service("/replace_crazyflie")
+        self.replaceCrazyflieService = rospy.ServiceProxy("/replace_crazyflie", ReplaceCrazyflie)
+        rospy.wait_for_service("/upload_trajectory")
+        self.uploadTrajectoryService = rospy.ServiceProxy("/upload_trajectory", UploadSwarmTrajectory)
+        rospy.wait_for_service("/stream_trajectory")
+        self.streamTrajectoryService = rospy.ServiceProxy("/stream_trajectory", StreamTrajectory)
+        rospy.wait_for_service("/upload_nn")
+        self.uploadNNService = rospy.ServiceProxy("/upload_nn", UploadSwarmNN)
 
         folder = os.path.dirname(__file__)
         file_name = os.path.join(folder, "../../launch/crazyflies.yaml")
@@ -164,6 +183,61 @@ class CrazyflieServer:
     def startTrajectory(self, trajectoryId, timescale = 1.0, reverse = False, relative = True, groupMask = 0):
         self.startTrajectoryService(groupMask, trajectoryId, timescale, reverse, relative)
 
-    # def setParam(self, name, value, group = 0):
-    #     rospy.set_param("/cfgroup" + str(group) + "/" + name, value)
-    #     self.updateParamsService(group, [name])
+    # timescale > 0: the server only uploads the trajectory if it is feasible at this
+    # timescale (res.violation, res.minTimescale); startTrajectory calls faster than
+    # the fastest feasible timescale are refused in any case
+    def uploadTrajectory(self, trajectoryId, pieceOffset, trajectory, ids = [], groupMask = 0, broadcast = False, timescale = 0, force = False):
+        pieces = trajectoryToPieces(trajectory)
+        res = self.uploadTrajectoryService(ids, groupMask, trajectoryId, pieceOffset, pieces, broadcast, timescale, force)
+        if res.violation:
+            print("WARNING: trajectory {} not uploaded: {}".format(trajectoryId, res.violation))
+        return res
+
+    def streamTrajectory(self, id, trajectoryId, pieceOffset, regionPieces, trajectory, lookahead = 1.0, timescale = 1.0, relative = False):
+        pieces = trajectoryToPieces(trajectory) if trajectory is not None else []
+        res = self.streamTrajectoryService(id, trajectoryId, pieceOffset, regionPieces, lookahead, timescale, relative, pieces)
+        return res.success, res.message
+
+    def uploadNN(self, fileName, ids = [], groupMask = 0, force = False):
+        return self.uploadNNService(fileName, ids, groupMask, force)
+
+    def queryTelemetry(self, variable, duration = 0, ids = [], maxSamples = 0):
+        res = self.queryTelemetryService(ids, variable, duration, maxSamples)
+        series = dict()
+        offsets = list(res.offsets) + [len(res.times)]
+        for i, id in enumerate(res.ids):
+            times = np.array(res.times[offsets[i]:offsets[i+1]])
+            values = np.array(res.values[offsets[i]:offsets[i+1]])
+            series[id] = (times, values)
+        return series, res
+
+    def setParam(self, name, value):
+        rospy.set_param("/allcfs/" + name, value)
+        self.updateParamsService([name])
+
+    def setParams(self, params):
+        for name, value in params.iteritems():
+            rospy.set_param("/allcfs/" + name, value)
+        self.updateParamsService(params.keys())
+
+    def addCrazyflie(self, id, channel, type, initialPosition):
+        res = self.addCrazyflieService(id, channel, type, initialPosition)
+        if res.success:
+            cf = Crazyflie(id, initialPosition, self.tf)
+            self.crazyflies.append(cf)
+            self.crazyfliesById[id] = cf
+        return res.success, res.message
+
+    def removeCrazyflie(self, id):
+        res = self.removeCrazyflieService(id)
+        if res.success:
+            self.crazyflies.remove(self.crazyfliesById.pop(id))
+        return res.success, res.message
+
+    def replaceCrazyflie(self, id, newId, initialPosition, type = ""):
+        res = self.replaceCrazyflieService(id, newId, type, initialPosition)
+        if res.success:
+            cf = Crazyflie(newId, initialPosition, self.tf)
+            self.crazyflies[self.crazyflies.index(self.crazyfliesById.pop(id))] = cf
+            self.crazyfliesById[newId] = cf
+        return res.success, res.message
@@ -4,11 +4,11 @@ import yaml
 import math
 import numpy as np
 
-import cfsim.cffirmware as firm
+import swarmsim
 
 # main class of simulation.
 # crazyflies keep reference to this object to ask what time it is.
-# also does the plotting.
+# also owns the planners of all crazyflies and does the plotting.
 #
 class TimeHelper:
     def __init__(self, vis, dt, writecsv):
@@ -18,11 +18,15 @@ class TimeHelper:
         elif vis == "vispy":
             import visualizer.visVispy
             self.visualizer = visualizer.visVispy.VisVispy()
+        elif vis == "null":
+            self.visualizer = None
         else:
             raise Exception("Unknown visualization backend: {}".format(vis))
         self.t = 0.0
         self.dt = dt
         self.crazyflies = []
+        self.swarm = swarmsim.SwarmSim()
+        self.states = None
         if writecsv:
             import output
             self.output = output.Output()
@@ -34,12 +38,25 @@ class TimeHelper:
 
     def step(self, duration):
         self.t += duration
+        self.states = None
+
+    # x, y, z, ax, ay, az, yaw of a crazyflie at the current time;
+    # all crazyflies are evaluated at once
+    def state(self, index):
+        if self.states is None:
+            self.states = self.swarm.evaluate(self.t)
+        return self.states[index]
+
+    # to be called after commands
+    def modified(self):
+        self.states = None
 
     # should be called "animate" or something
     # but called "sleep" for source-compatibility with real-robot scripts
     def sleep(self, duration):
         for t in np.arange(self.t, self.t + duration, self.dt):
-            self.visualizer.update(t, self.crazyflies)
+            if self.visualizer:
+                self.visualizer.update(t, self.crazyflies)
             if self.output:
                 self.output.update(t, self.crazyflies)
             self.step(self.dt)
@@ -52,82 +69,58 @@ class TimeHelper:
         self.observers.append(observer)
 
 
-# helper func to convert python/numpy arrays to firmware 3d vector type.
-def arr2vec(a):
-    return firm.mkvec(a[0], a[1], a[2])
-
-
 class Crazyflie:
 
-    def __init__(self, id, initialPosition, timeHelper):
+    # index: replaces the crazyflie with this index in the swarm
+    def __init__(self, id, initialPosition, timeHelper, index = None):
         self.id = id
         self.initialPosition = np.array(initialPosition)
         self.time = lambda: timeHelper.time()
+        self.timeHelper = timeHelper
+        self.swarm = timeHelper.swarm
 
-        self.planner = firm.planner()
-        firm.plan_init(self.planner)
-        self.planner.lastKnownPosition = arr2vec(initialPosition)
+        if index is None:
+            self.index = self.swarm.add(initialPosition)
+        else:
+            self.index = index
+            self.swarm.reset(index, initialPosition)
+        self.timeHelper.modified()
         self.groupMask = 0
-        self.trajectories = dict()
 
     def setGroupMask(self, groupMask):
         self.groupMask = groupMask
 
     def takeoff(self, targetHeight, duration, groupMask = 0):
         if self._isGroup(groupMask):
-            firm.plan_takeoff(self.planner,
-                self._vposition(), self.yaw(), targetHeight, duration, self.time())
+            self.swarm.takeoff(self.index, targetHeight, duration, self.time())
+            self.timeHelper.modified()
 
     def land(self, targetHeight, duration, groupMask = 0):
         if self._isGroup(groupMask):
-            firm.plan_land(self.planner,
-                self._vposition(), self.yaw(), targetHeight, duration, self.time())
+            self.swarm.land(self.index, targetHeight, duration, self.time())
+            self.timeHelper.modified()
 
     def stop(self, groupMask = 0):
         if self._isGroup(groupMask):
-            firm.plan_stop(self.planner)
+            self.swarm.stop(self.index)
+            self.timeHelper.modified()
 
     def goTo(self, goal, yaw, duration, relative = False, groupMask = 0):
         if self._isGroup(groupMask):
-            firm.plan_go_to(self.planner, relative, arr2vec(goal), yaw, duration, self.time())
+            self.swarm.goTo(self.index, relative, goal, yaw, duration, self.time())
+            self.timeHelper.modified()
 
+    # trajectory: Trajectory or swarmsim.pieces(trajectory)
     def uploadTrajectory(self, trajectoryId, pieceOffset, trajectory):
-        traj = firm.piecewise_traj()
-        traj.t_begin = 0
-        traj.timescale = 1.0
-        traj.shift = firm.mkvec(0, 0, 0)
-        traj.n_pieces = len(trajectory.polynomials)
-        traj.pieces = firm.malloc_poly4d(len(trajectory.polynomials))
-        for i, poly in enumerate(trajectory.polynomials):
-            piece = firm.pp_get_piece(traj, i)
-            piece.duration = poly.duration
-            for coef in range(0, 8):
-                firm.poly4d_set(piece, 0, coef, poly.px.p[coef])
-                firm.poly4d_set(piece, 1, coef, poly.py.p[coef])
-                firm.poly4d_set(piece, 2, coef, poly.pz.p[coef])
-                firm.poly4d_set(piece, 3, coef, poly.pyaw.p[coef])
-        self.trajectories[trajectoryId] = traj
+        self.swarm.uploadTrajectory(self.index, trajectoryId, trajectory)
 
     def startTrajectory(self, trajectoryId, timescale = 1.0, reverse = False, relative = True, groupMask = 0):
         if self._isGroup(groupMask):
-            traj = self.trajectories[trajectoryId]
-            traj.t_begin = self.time()
-            traj.timescale = timescale
-            if relative:
-                pos = self._vposition()
-                traj.shift = firm.vzero()
-                if reverse:
-                    traj_init = firm.piecewise_eval_reversed(traj, traj.t_begin)
-                else:
-                    traj_init = firm.piecewise_eval(traj, traj.t_begin)
-                traj.shift = firm.vsub(pos, traj_init.pos)
-            else:
-                traj.shift = firm.vzero()
-            firm.plan_start_trajectory(self.planner, traj, reverse)
+            self.swarm.startTrajectory(self.index, trajectoryId, timescale, reverse, relative, self.time())
+            self.timeHelper.modified()
 
     def position(self):
-        pos = self._vposition()
-        return np.array([pos.x, pos.y, pos.z])
+        return np.array(self.timeHelper.state(self.index)[0:3], dtype=float)
 
     def getParam(self, name):
         print("WARNING: getParam not implemented in simulation!")
@@ -140,15 +133,10 @@ class Crazyflie:
 
     # simulation only functions
     def yaw(self):
-        ev = firm.plan_current_goal(self.planner, self.time())
-        return ev.yaw
+        return float(self.timeHelper.state(self.index)[6])
 
     def acceleration(self):
-        if self.planner.state == firm.TRAJECTORY_STATE_IDLE:
-            return np.array([0, 0, 0])
-        else:
-            ev = firm.plan_current_goal(self.planner, self.time())
-            return np.array([ev.acc.x, ev.acc.y, ev.acc.z])
+        return np.array(self.timeHelper.state(self.index)[3:6], dtype=float)
 
     def rpy(self):
         acc = self.acceleration()
@@ -171,18 +159,6 @@ class Crazyflie:
     def _isGroup(self, groupMask):
         return groupMask == 0 or (self.groupMask & groupMask) > 0
 
-    def _vposition(self):
-        # TODO this should be implemented in C
-        # print(self.id, self.planner, self.planner.state)
-        if self.planner.state == firm.TRAJECTORY_STATE_IDLE:
-            return self.planner.lastKnownPosition
-        else:
-            ev = firm.plan_current_goal(self.planner, self.time())
-            self.planner.lastKnownPosition = firm.mkvec(ev.pos.x, ev.pos.y, ev.pos.z)
-            # print(self.id, ev.pos.z)
-            # not totally sure why, but if we don't do this, we don't actually return by value
-            return firm.mkvec(ev.pos.x, ev.pos.y, ev.pos.z)
-
 
 class CrazyflieServer:
     def __init__(self, timeHelper):
@@ -223,3 +199,55 @@ class CrazyflieServer:
     def startTrajectory(self, trajectoryId, timescale = 1.0, reverse = False, relative = True, groupMask = 0):
         for crazyflie in self.crazyflies:
             crazyflie.startTrajectory(trajectoryId, timescale, reverse, relative, groupMask)
+
+    # the simulation has no dynamics limits, so the timescale is not checked
+    # (see checkTrajectories.py feasibility)
+    def uploadTrajectory(self, trajectoryId, pieceOffset, trajectory, ids = [], groupMask = 0, broadcast = False, timescale = 0, force = False):
+        pieces = swarmsim.pieces(trajectory)
+        for crazyflie in self.crazyflies:
+            selected = crazyflie.id in ids if ids else crazyflie._isGroup(groupMask)
+            if selected:
+                crazyflie.uploadTrajectory(trajectoryId, pieceOffset, pieces)
+
+    def streamTrajectory(self, id, trajectoryId, pieceOffset, regionPieces, trajectory, lookahead = 1.0, timescale = 1.0, relative = False):
+        # the simulated memory is not limited, so the whole trajectory is uploaded at once
+        crazyflie = self.crazyfliesById[id]
+        if trajectory is None:
+            return True, "Stopped streaming"
+        if relative:
+            return False, "relative is not supported for streams; use absolute pieces"
+        crazyflie.uploadTrajectory(trajectoryId, pieceOffset, trajectory)
+        crazyflie.startTrajectory(trajectoryId, timescale, relative = False)
+        return True, ""
+
+    def uploadNN(self, fileName, ids = [], groupMask = 0, force = False):
+        print("WARNING: uploadNN not implemented in simulation!")
+
+    def setParam(self, name, value):
+        print("WARNING: setParam not implemented in simulation!")
+
+    def setParams(self, params):
+        print("WARNING: setParams not implemented in simulation!")
+
+    def addCrazyflie(self, id, channel, type, initialPosition):
+        cf = Crazyflie(id, initialPosition, self.timeHelper)
+        self.crazyflies.append(cf)
+        self.crazyfliesById[id] = cf
+        return True, ""
+
+    def removeCrazyflie(self, id):
+        cf = self.crazyfliesById.pop(id)
+        self.crazyflies.remove(cf)
+        self.timeHelper.swarm.remove(cf.index)
+        self.timeHelper.modified()
+        for other in self.crazyflies:
+            if other.index > cf.index:
+                other.index -= 1
+        return True, ""
+
+    def replaceCrazyflie(self, id, newId, initialPosition, type = ""):
+        old = self.crazyfliesById.pop(id)
+        cf = Crazyflie(newId, initialPosition, self.timeHelper, old.index)
+        self.crazyflies[self.crazyflies.index(old)] = cf
+        self.crazyfliesById[newId] = cf
+        return True, ""
@@ -7,7 +7,7 @@ class Crazyswarm:
         if parse_args:
             parser = argparse.ArgumentParser()
             parser.add_argument("--sim", help="Run using simulation", action="store_true")
-            parser.add_argument("--vis", help="(sim only) Visualization backend [mpl]", choices=['mpl', 'vispy'], default="mpl")
+            parser.add_argument("--vis", help="(sim only) Visualization backend [mpl]", choices=['mpl', 'vispy', 'null'], default="mpl")
             parser.add_argument("--dt", help="(sim only) dt [0.1s]", type=float, default=0.1)
             parser.add_argument("--writecsv", help="Enable CSV output (only available in simulation)", action="store_true")
             args = parser.parse_args()
@@ -0,0 +1,42 @@
+// Typemaps shared by the SWIG modules (swigged with -I..):
+// float32 buffers (e.g., C-contiguous numpy arrays), without copying.
+// The typecheck rules let SWIG dispatch overloads (e.g., default arguments).
+%define %const_float_buffer(DATA, SIZE)
+%typemap(in) (const float* DATA, size_t SIZE) (Py_buffer view) {
+  view.obj = NULL;
+  if (PyObject_GetBuffer($input, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0
+      || view.itemsize != sizeof(float) || !view.format || view.format[0] != 'f') {
+    SWIG_exception_fail(SWIG_TypeError, "expected a contiguous float32 array");
+  }
+  $1 = static_cast<const float*>(view.buf);
+  $2 = view.len / sizeof(float);
+}
+%typemap(freearg) (const float* DATA, size_t SIZE) {
+  if (view$argnum.obj) {
+    PyBuffer_Release(&view$argnum);
+  }
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_POINTER) (const float* DATA, size_t SIZE) {
+  $1 = PyObject_CheckBuffer($input);
+}
+%enddef
+
+%define %float_buffer(DATA, SIZE)
+%typemap(in) (float* DATA, size_t SIZE) (Py_buffer view) {
+  view.obj = NULL;
+  if (PyObject_GetBuffer($input, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | PyBUF_WRITABLE) != 0
+      || view.itemsize != sizeof(float) || !view.format || view.format[0] != 'f') {
+    SWIG_exception_fail(SWIG_TypeError, "expected a writable contiguous float32 array");
+  }
+  $1 = static_cast<float*>(view.buf);
+  $2 = view.len / sizeof(float);
+}
+%typemap(freearg) (float* DATA, size_t SIZE) {
+  if (view$argnum.obj) {
+    PyBuffer_Release(&view$argnum);
+  }
+}
+%typemap(typecheck, precedence=SWIG_TYPECHECK_POINTER) (float* DATA, size_t SIZE) {
+  $1 = PyObject_CheckBuffer($input);
+}
+%enddef
@@ -0,0 +1,22 @@
+import numpy as np
+
+from . import nninference
+
+# Batched evaluation of a NN descriptor (as sent by uploadNN), see src/nn_inference.h.
+# Build with make (needs swig).
+class NN:
+    def __init__(self, fileName):
+        self._nn = nninference.NNEvaluator(fileName)
+        self.inputs = self._nn.inputs()
+        self.outputs = self._nn.outputs()
+        self.summary = self._nn.summary()
+
+    # states: n x inputs (or a single state); returns n x outputs
+    # numThreads = 0: all cores
+    def evaluate(self, states, numThreads = 1):
+        x = np.ascontiguousarray(states, dtype=np.float32)
+        single = x.ndim == 1
+        x = x.reshape(-1, self.inputs)
+        y = np.empty((x.shape[0], self.outputs), dtype=np.float32)
+        self._nn.evaluate(x, y, numThreads)
+        return y[0] if single else y
@@ -0,0 +1,78 @@
+%module nninference
+%{
+#include <stdexcept>
+#include "mapped_file.h"
+#include "nn_inference.h"
+%}
+
+%include "std_string.i"
+%include "exception.i"
+
+%exception {
+  try {
+    $action
+  } catch (std::exception& e) {
+    SWIG_exception(SWIG_RuntimeError, e.what());
+  }
+}
+
+%include "float_buffer.i"
+
+%const_float_buffer(input, inputSize)
+%float_buffer(output, outputSize)
+
+%inline %{
+class NNEvaluator
+{
+public:
+  NNEvaluator(const std::string& fileName)
+  {
+    MappedFile file(fileName);
+    if (!file.valid()) {
+      throw std::runtime_error(file.error());
+    }
+    if (!m_nn.load(file.data(), file.size(), m_summary)) {
+      throw std::runtime_error(fileName + ": " + m_summary);
+    }
+  }
+
+  size_t inputs() const {
+    return m_nn.inputs();
+  }
+
+  size_t outputs() const {
+    return m_nn.outputs();
+  }
+
+  std::string summary() const {
+    return m_summary;
+  }
+
+  // input: n x inputs(), output: n x outputs(); numThreads = 0: all cores
+  void evaluate(const float* input, size_t inputSize, float* output, size_t outputSize, size_t numThreads)
+  {
+    size_t count = inputSize / m_nn.inputs();
+    if (count * m_nn.inputs() != inputSize || outputSize != count * m_nn.outputs()) {
+      throw std::runtime_error("input and output sizes do not match the network");
+    }
+    // an exception must not leave the block without the GIL
+    bool failed = false;
+    std::string error;
+    Py_BEGIN_ALLOW_THREADS
+    try {
+      m_nn.evaluate(input, output, count, numThreads);
+    } catch (std::exception& e) {
+      failed = true;
+      error = e.what();
+    }
+    Py_END_ALLOW_THREADS
+    if (failed) {
+      throw std::runtime_error(error);
+    }
+  }
+
+private:
+  NNInference m_nn;
+  std::string m_summary;
+};
+%}
@@ -0,0 +1,12 @@
+import numpy as np
+
+# duration, 8 coefficients of x, y, z, yaw (as PieceSize of piecewise_batch.h and swarm_sim.h)
+PieceSize = 1 + 4 * 8
+
+# Trajectory (uav_trajectory.py) as n x PieceSize array, like the trajectory csv files
+def fromTrajectory(trajectory):
+    result = np.empty((len(trajectory.polynomials), PieceSize), dtype=np.float32)
+    for i, poly in enumerate(trajectory.polynomials):
+        result[i, 0] = poly.duration
+        result[i, 1:] = np.concatenate([poly.px.p, poly.py.p, poly.pz.p, poly.pyaw.p])
+    return result
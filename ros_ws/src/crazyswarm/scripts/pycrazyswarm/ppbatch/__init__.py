@@ -0,0 +1,55 @@
+import numpy as np
+
+from . import ppbatch
+
+# Trajectory (uav_trajectory.py) as n x PieceSize array (see pieces.py)
+from ..pieces import fromTrajectory as pieces
+
+# Limits of an entry of dynamicsConfigurations (crazyflieTypes.yaml), as checked by the server
+# (see trajectory_thrust_to_weight in hover_swarm.launch)
+def limits(dynamics, thrustToWeight = 1.9, maxThrust = 1.0):
+    result = ppbatch.FeasibilityLimits()
+    result.maxVelocityX = dynamics["maxXVelocity"]
+    result.maxVelocityY = dynamics["maxYVelocity"]
+    result.maxVelocityZ = dynamics["maxZVelocity"]
+    result.maxTilt = min(dynamics["maxRoll"], dynamics["maxPitch"])
+    result.maxBodyRate = min(dynamics["maxRollRate"], dynamics["maxPitchRate"])
+    result.maxYawRate = dynamics["maxYawRate"]
+    result.maxThrustToWeight = thrustToWeight * maxThrust
+    return result
+
+# Batched evaluation of many trajectories, see src/piecewise_batch.h. Build with make (needs swig).
+class Trajectories(ppbatch.PiecewiseBatch):
+    def __init__(self, numThreads = 0):
+        ppbatch.PiecewiseBatch.__init__(self)
+        self.numThreads = numThreads
+
+    # trajectory: Trajectory or n x PieceSize array; shift: added to x, y, z
+    def add(self, trajectory, timescale = 1.0, shift = (0, 0, 0)):
+        if not isinstance(trajectory, np.ndarray):
+            trajectory = pieces(trajectory)
+        trajectory = np.ascontiguousarray(trajectory, dtype=np.float32)
+        return ppbatch.PiecewiseBatch.add(self, trajectory, timescale, *[float(x) for x in shift])
+
+    # Returns size() x (derivatives + 1) x 4 (x, y, z, yaw) x len(times)
+    def evaluate(self, times, derivatives = 0):
+        times = np.ascontiguousarray(times, dtype=np.float32).reshape(-1)
+        output = np.empty((self.size(), derivatives + 1, ppbatch.PiecewiseBatch.NumAxes, len(times)), dtype=np.float32)
+        ppbatch.PiecewiseBatch.evaluate(self, times, derivatives, output, self.numThreads)
+        return output
+
+    # limits: FeasibilityLimits for all, or one per trajectory; returns a FeasibilityResult per
+    # trajectory (see src/trajectory_feasibility.h)
+    def checkFeasibility(self, limits, sampleTime = 0.01):
+        if isinstance(limits, ppbatch.FeasibilityLimits):
+            limits = [limits]
+        results = ppbatch.FeasibilityResultVector()
+        ppbatch.TrajectoryFeasibility.check(self, ppbatch.FeasibilityLimitsVector(limits), sampleTime, results, self.numThreads)
+        return list(results)
+
+    # Pairs closer than the ellipsoid (radiusXY in x/y, radiusZ in z for the downwash), with the
+    # shifts as positions; returns Collisions (see src/collision_checker.h)
+    def checkCollisions(self, radiusXY = 0.12, radiusZ = 0.3, sampleTime = 0.01, duration = 0):
+        collisions = ppbatch.CollisionVector()
+        ppbatch.CollisionChecker.check(self, radiusXY, radiusZ, sampleTime, collisions, self.numThreads, duration)
+        return list(collisions)
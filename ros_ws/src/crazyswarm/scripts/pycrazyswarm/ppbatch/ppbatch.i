@@ -0,0 +1,36 @@
+%module ppbatch
+%{
+#include "piecewise_batch.h"
+#include "trajectory_feasibility.h"
+#include "collision_checker.h"
+%}
+
+%include "exception.i"
+%include "std_vector.i"
+
+%exception {
+  try {
+    $action
+  } catch (std::exception& e) {
+    SWIG_exception(SWIG_RuntimeError, e.what());
+  }
+}
+
+%include "float_buffer.i"
+
+%const_float_buffer(pieces, size)
+%const_float_buffer(times, numTimes)
+%float_buffer(output, outputSize)
+
+%include "piecewise_batch.h"
+
+// instantiated before the checker, which takes them by reference
+struct FeasibilityLimits;
+struct FeasibilityResult;
+struct Collision;
+%template(FeasibilityLimitsVector) std::vector<FeasibilityLimits>;
+%template(FeasibilityResultVector) std::vector<FeasibilityResult>;
+%template(CollisionVector) std::vector<Collision>;
+
+%include "trajectory_feasibility.h"
+%include "collision_checker.h"
@@ -0,0 +1,36 @@
+import numpy as np
+
+from . import swarmsim
+
+# Trajectory (uav_trajectory.py) as n x PieceSize array (see pieces.py)
+from ..pieces import fromTrajectory as pieces
+
+# Planners of all simulated CFs, see swarm_sim.h. Build with make (needs swig).
+class SwarmSim(swarmsim.SwarmSim):
+    def __init__(self, numThreads = 0):
+        swarmsim.SwarmSim.__init__(self)
+        self.numThreads = numThreads
+
+    def add(self, position):
+        return swarmsim.SwarmSim.add(self, *[float(x) for x in position])
+
+    def reset(self, index, position):
+        swarmsim.SwarmSim.reset(self, index, *[float(x) for x in position])
+
+    def goTo(self, index, relative, goal, yaw, duration, t):
+        swarmsim.SwarmSim.goTo(self, index, bool(relative), float(goal[0]), float(goal[1]), float(goal[2]), yaw, duration, t)
+
+    # trajectory: Trajectory or the result of pieces()
+    def uploadTrajectory(self, index, trajectoryId, trajectory):
+        if not isinstance(trajectory, np.ndarray):
+            trajectory = pieces(trajectory)
+        swarmsim.SwarmSim.uploadTrajectory(self, index, trajectoryId, np.ascontiguousarray(trajectory, dtype=np.float32))
+
+    def startTrajectory(self, index, trajectoryId, timescale, reverse, relative, t):
+        swarmsim.SwarmSim.startTrajectory(self, index, trajectoryId, timescale, bool(reverse), bool(relative), t)
+
+    # Returns size() x StateSize: x, y, z, ax, ay, az, yaw of all CFs at time t
+    def evaluate(self, t):
+        states = np.empty((self.size(), swarmsim.SwarmSim.StateSize), dtype=np.float32)
+        swarmsim.SwarmSim.evaluate(self, t, states, self.numThreads)
+        return states
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel_for.h"
+
+extern "C" {
+#include "planner.h"
+}
+
+/*
+Batch simulation of the high-level planner of many CFs (used by crazyflieSim.py)
+ * The planners of all CFs are stored in one array. evaluate() computes the state of all CFs at a
+   point in time with a single call, spread over threads for large swarms.
+ * Commands mirror the firmware planner and address a CF by its index (the order of add()).
+   remove() shifts the indices of the following CFs down by one.
+ * A planner points to its own planned trajectory (takeoff, land, goTo) or to an uploaded
+   trajectory, so these pointers are restored whenever CFs move in the array.
+*/
+
+class SwarmSim
+{
+public:
+  static constexpr size_t StateSize = 7;              // x, y, z, ax, ay, az, yaw
+  static constexpr size_t PieceSize = 1 + 4 * 8;      // duration, 8 coefficients of x, y, z, yaw
+  static constexpr size_t MinCrazyfliesPerThread = 256;
+
+  size_t size() const {
+    return m_vehicles.size();
+  }
+
+  size_t add(float x, float y, float z)
+  {
+    size_t capacity = m_vehicles.capacity();
+    m_vehicles.emplace_back();
+    init(m_vehicles.back(), x, y, z);
+    rebind(m_vehicles.capacity() == capacity ? m_vehicles.size() - 1 : 0);
+    return m_vehicles.size() - 1;
+  }
+
+  void remove(size_t index)
+  {
+    check(index);
+    m_vehicles.erase(m_vehicles.begin() + index);
+    rebind(index);
+  }
+
+  // Starts over with a new CF at the given index
+  void reset(size_t index, float x, float y, float z)
+  {
+    check(index);
+    init(m_vehicles[index], x, y, z);
+    rebind(index);
+  }
+
+  void takeoff(size_t index, float height, float duration, float t)
+  {
+    Vehicle& v = vehicle(index, t);
+    plan_takeoff(&v.planner, v.position, v.yaw, height, duration, t);
+    v.activeTrajectory = -1;
+  }
+
+  void land(size_t index, float height, float duration, float t)
+  {
+    Vehicle& v = vehicle(index, t);
+    plan_land(&v.planner, v.position, v.yaw, height, duration, t);
+    v.activeTrajectory = -1;
+  }
+
+  void stop(size_t index)
+  {
+    check(index);
+    plan_stop(&m_vehicles[index].planner);
+  }
+
+  void goTo(size_t index, bool relative, float x, float y, float z, float yaw, float duration, float t)
+  {
+    Vehicle& v = vehicle(index, t);
+    plan_go_to(&v.planner, relative, mkvec(x, y, z), yaw, duration, t);
+    v.activeTrajectory = -1;
+  }
+
+  // pieces: n x PieceSize
+  void uploadTrajectory(size_t index, int trajectoryId, const float* pieces, size_t size)
+  {
+    check(index);
+    if (size % PieceSize != 0) {
+      throw std::runtime_error("pieces have to be n x " + std::to_string(PieceSize));
+    }
+    Trajectory& trajectory = m_vehicles[index].trajectories[trajectoryId];
+    trajectory.pieces.resize(size / PieceSize);
+    for (size_t i = 0; i < trajectory.pieces.size(); ++i) {
+      const float* piece = pieces + i * PieceSize;
+      trajectory.pieces[i].duration = piece[0];
+      for (size_t axis = 0; axis < 4; ++axis) {
+        for (size_t coef = 0; coef < 8; ++coef) {
+          trajectory.pieces[i].p[axis][coef] = piece[1 + axis * 8 + coef];
+        }
+      }
+    }
+    // like the firmware's trajectory memory, a trajectory that is executed changes in place
+    if (m_vehicles[index].planner.trajectory != &trajectory.traj) {
+      trajectory.traj.t_begin = 0;
+      trajectory.traj.timescale = 1.0;
+      trajectory.traj.shift = vzero();
+    }
+    trajectory.traj.n_pieces = trajectory.pieces.size();
+    trajectory.traj.pieces = trajectory.pieces.data();
+  }
+
+  void startTrajectory(size_t index, int trajectoryId, float timescale, bool reversed, bool relative, float t)
+  {
+    Vehicle& v = vehicle(index, t);
+    auto it = v.trajectories.find(trajectoryId);
+    if (it == v.trajectories.end()) {
+      throw std::runtime_error("trajectory " + std::to_string(trajectoryId) + " was not uploaded");
+    }
+    struct piecewise_traj& traj = it->second.traj;
+    traj.t_begin = t;
+    traj.timescale = timescale;
+    traj.shift = vzero();
+    if (relative) {
+      struct traj_eval init = reversed ? piecewise_eval_reversed(&traj, t) : piecewise_eval(&traj, t);
+      traj.shift = vsub(v.position, init.pos);
+    }
+    plan_start_trajectory(&v.planner, &traj, reversed);
+    v.activeTrajectory = trajectoryId;
+  }
+
+  // states: size() x StateSize; numThreads = 0: all cores
+  void evaluate(float t, float* states, size_t size, size_t numThreads = 1)
+  {
+    if (size != m_vehicles.size() * StateSize) {
+      throw std::runtime_error("states have to be " + std::to_string(m_vehicles.size()) + " x " + std::to_string(StateSize));
+    }
+    size_t maxThreads = (m_vehicles.size() + MinCrazyfliesPerThread - 1) / MinCrazyfliesPerThread;
+    numThreads = threadCount(numThreads, maxThreads);
+
+    // one contiguous chunk of CFs per thread
+    size_t chunk = (m_vehicles.size() + numThreads - 1) / numThreads;
+    auto work = [&](size_t thread) {
+      size_t last = std::min((thread + 1) * chunk, m_vehicles.size());
+      for (size_t i = thread * chunk; i < last; ++i) {
+        evaluate(m_vehicles[i], t, states + i * StateSize);
+      }
+    };
+    parallelFor(numThreads, numThreads, work);
+  }
+
+private:
+  struct Trajectory
+  {
+    struct piecewise_traj traj;
+    std::vector<struct poly4d> pieces;
+  };
+
+  struct Vehicle
+  {
+    struct planner planner;
+    std::map<int, Trajectory> trajectories;
+    int activeTrajectory;   // -1: the planner's own trajectory
+    struct vec position;    // last known
+    float yaw;              // last known
+  };
+
+  static void init(Vehicle& v, float x, float y, float z)
+  {
+    plan_init(&v.planner);
+    v.trajectories.clear();
+    v.activeTrajectory = -1;
+    v.position = mkvec(x, y, z);
+    v.yaw = 0;
+  }
+
+  static void evaluate(Vehicle& v, float t, float* state)
+  {
+    struct vec acc = vzero();
+    if (v.planner.state != TRAJECTORY_STATE_IDLE) {
+      struct traj_eval ev = plan_current_goal(&v.planner, t);
+      v.position = ev.pos;
+      v.yaw = ev.yaw;
+      acc = ev.acc;
+    }
+    state[0] = v.position.x;
+    state[1] = v.position.y;
+    state[2] = v.position.z;
+    state[3] = acc.x;
+    state[4] = acc.y;
+    state[5] = acc.z;
+    state[6] = v.yaw;
+  }
+
+  void rebind(size_t first)
+  {
+    for (size_t i = first; i < m_vehicles.size(); ++i) {
+      Vehicle& v = m_vehicles[i];
+      v.planner.planned_trajectory.pieces = v.planner.pieces;
+      for (auto& it : v.trajectories) {
+        it.second.traj.pieces = it.second.pieces.data();
+      }
+      if (v.planner.trajectory) {
+        v.planner.trajectory = v.activeTrajectory < 0
+          ? &v.planner.planned_trajectory
+          : &v.trajectories.at(v.activeTrajectory).traj;
+      }
+    }
+  }
+
+  void check(size_t index) const
+  {
+    if (index >= m_vehicles.size()) {
+      throw std::out_of_range("no CF with index " + std::to_string(index));
+    }
+  }
+
+  // The CF with its last known position and yaw at time t
+  Vehicle& vehicle(size_t index, float t)
+  {
+    check(index);
+    float state[StateSize];
+    evaluate(m_vehicles[index], t, state);
+    return m_vehicles[index];
+  }
+
+  std::vector<Vehicle> m_vehicles;
+};
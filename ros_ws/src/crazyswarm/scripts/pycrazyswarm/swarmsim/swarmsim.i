@@ -0,0 +1,21 @@
+%module swarmsim
+%{
+#include "swarm_sim.h"
+%}
+
+%include "exception.i"
+
+%exception {
+  try {
+    $action
+  } catch (std::exception& e) {
+    SWIG_exception(SWIG_RuntimeError, e.what());
+  }
+}
+
+%include "float_buffer.i"
+
+%const_float_buffer(pieces, size)
+%float_buffer(states, size)
+
+%include "swarm_sim.h"
@@ -0,0 +1,32 @@
+#!/usr/bin/env python
+
+# Measures the round trip of no-op service calls, i.e., the dispatch latency
+# of the server's service queue (/update_params) and of a group's queue
+# (/cf<id>/update_params), e.g., before and after a change of crazyswarm_server.
+
+import sys
+import time
+import numpy as np
+import rospy
+from crazyflie_driver.srv import UpdateParams
+
+def measure(name, numCalls):
+    rospy.wait_for_service(name)
+    service = rospy.ServiceProxy(name, UpdateParams, persistent=True)
+    durations = []
+    for i in range(numCalls):
+        start = time.time()
+        service([])
+        durations.append(time.time() - start)
+        # avoid syncing with a polling loop
+        time.sleep(np.random.uniform(0.0, 0.02))
+    d = np.array(durations) * 1000
+    print("{}: mean {:.2f} ms, median {:.2f} ms, p95 {:.2f} ms, max {:.2f} ms ({} calls)".format(
+        name, np.mean(d), np.median(d), np.percentile(d, 95), np.max(d), numCalls))
+
+if __name__ == "__main__":
+    rospy.init_node("serviceLatency", anonymous=True)
+    cfId = int(sys.argv[1]) if len(sys.argv) > 1 else 1
+    numCalls = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+    measure("/update_params", numCalls)
+    measure("/cf{}/update_params".format(cfId), numCalls)
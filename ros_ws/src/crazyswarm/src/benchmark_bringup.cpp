@@ -0,0 +1,115 @@
+#include <iostream>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include <crazyflie_cpp/Crazyflie.h>
+
+#include "parallel_for.h"
+
+// Compares the bring-up of crazyswarm_server with one CF after the other
+// (bringup_concurrency: 1) and with the requests of several CFs interleaved
+// on the radio, phase by phase. Requires the given CFs to be turned on; the
+// TOCs are fetched without the cache, so both variants transfer the same data.
+
+struct Phase
+{
+  const char* name;
+  std::function<void(Crazyflie&)> run;
+};
+
+static double benchmarkPhase(
+  const std::vector<std::unique_ptr<Crazyflie> >& cfs,
+  const Phase& phase,
+  size_t concurrency)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  parallelFor(cfs.size(), concurrency, [&](size_t i) {
+    phase.run(*cfs[i]);
+  });
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<std::string> uris;
+  size_t concurrency;
+  size_t iterations;
+
+  namespace po = boost::program_options;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("uri", po::value<std::vector<std::string> >(&uris)->multitoken()->required(), "CFs on one radio (e.g., radio://0/100/2M/E7E7E7E701)")
+    ("concurrency", po::value<size_t>(&concurrency)->default_value(4), "CFs brought up at the same time (as bringup_concurrency)")
+    ("iterations", po::value<size_t>(&iterations)->default_value(3), "runs of each phase and variant (the fastest counts)")
+  ;
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+    po::notify(vm);
+  }
+  catch(po::error& e)
+  {
+    std::cerr << e.what() << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  // the phases of CrazyflieGroup::CrazyflieGroup and CrazyflieROS::run that talk to the CF
+  std::vector<Phase> phases = {
+    {"syson", [](Crazyflie& cf) {
+      cf.syson();
+      for (size_t i = 0; i < 50; ++i) {
+        cf.sendPing();
+      }
+    }},
+    {"paramToc", [](Crazyflie& cf) { cf.requestParamToc(true); }},
+    {"logToc", [](Crazyflie& cf) { cf.requestLogToc(true); }},
+    {"memoryToc", [](Crazyflie& cf) { cf.requestMemoryToc(); }},
+  };
+
+  std::vector<std::unique_ptr<Crazyflie> > cfs;
+  for (const auto& uri : uris) {
+    cfs.emplace_back(new Crazyflie(uri));
+  }
+
+  std::cout << "CFs: " << cfs.size() << ", concurrency: " << concurrency << std::endl;
+  double totalSerial = 0;
+  double totalInterleaved = 0;
+  try {
+    for (const auto& phase : phases) {
+      double serial = 0;
+      double interleaved = 0;
+      for (size_t i = 0; i < iterations; ++i) {
+        double s = benchmarkPhase(cfs, phase, 1);
+        double p = benchmarkPhase(cfs, phase, concurrency);
+        serial = i == 0 ? s : std::min(serial, s);
+        interleaved = i == 0 ? p : std::min(interleaved, p);
+      }
+      totalSerial += serial;
+      totalInterleaved += interleaved;
+      std::cout << phase.name << ": serial " << serial << " s, interleaved " << interleaved
+        << " s (speedup: " << serial / interleaved << ")" << std::endl;
+    }
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+  std::cout << "total: serial " << totalSerial << " s, interleaved " << totalInterleaved
+    << " s (speedup: " << totalSerial / totalInterleaved << ")" << std::endl;
+
+  return 0;
+}
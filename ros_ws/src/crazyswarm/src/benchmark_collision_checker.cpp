@@ -0,0 +1,208 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <tuple>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "collision_checker.h"
+
+// Compares CollisionChecker::check with a brute-force test of all pairs of
+// CFs at every sample, on random trajectories of a swarm on a grid, and
+// reports whether both find the same collisions.
+// Build with -DCMAKE_BUILD_TYPE=Release (or -O3 -march=native, as ppbatch).
+
+static void randomPieces(
+  std::mt19937& generator,
+  size_t numPieces,
+  double amplitude,
+  std::vector<float>& pieces)
+{
+  const size_t PieceSize = PiecewiseBatch::PieceSize;
+  const size_t NumCoefficients = PiecewiseBatch::NumCoefficients;
+  std::uniform_real_distribution<float> duration(0.5, 1.5);
+  std::uniform_real_distribution<float> coefficient(-amplitude, amplitude);
+  pieces.assign(numPieces * PieceSize, 0);
+  for (size_t i = 0; i < numPieces; ++i) {
+    float* piece = &pieces[i * PieceSize];
+    piece[0] = duration(generator);
+    // x, y, z; higher orders smaller, so that the CFs stay near their start
+    for (size_t axis = 0; axis < 3; ++axis) {
+      for (size_t k = 0; k < NumCoefficients; ++k) {
+        piece[1 + axis * NumCoefficients + k] = coefficient(generator) * std::pow(0.5f, k);
+      }
+    }
+  }
+}
+
+// As CollisionChecker::check, with all pairs at all samples
+static double benchmarkBruteForce(
+  const PiecewiseBatch& trajectories,
+  double radiusXY,
+  double radiusZ,
+  double sampleTime,
+  double duration,
+  std::vector<Collision>& collisions)
+{
+  const size_t NumAxes = PiecewiseBatch::NumAxes;
+  const size_t numCFs = trajectories.size();
+  const float scaleZ = radiusXY / radiusZ;
+  const float threshold = (float)radiusXY * (float)radiusXY;
+  collisions.clear();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t numSamples = (size_t)std::ceil(duration / sampleTime) + 1;
+  std::vector<float> times(numSamples);
+  for (size_t s = 0; s < numSamples; ++s) {
+    times[s] = std::min(s * sampleTime, duration);
+  }
+  std::vector<float> output(trajectories.outputSizeFor(numSamples, 0));
+  trajectories.evaluate(times.data(), numSamples, 0, output.data(), output.size());
+
+  // per pair: index of its open collision (the pair collided at the previous sample)
+  std::vector<size_t> open(numCFs * numCFs, SIZE_MAX);
+  std::vector<float> closest;
+  std::vector<float> positions(3 * numCFs);
+  for (size_t s = 0; s < numSamples; ++s) {
+    for (size_t i = 0; i < numCFs; ++i) {
+      const float* p = &output[i * NumAxes * numSamples + s];
+      positions[3 * i] = p[0];
+      positions[3 * i + 1] = p[numSamples];
+      positions[3 * i + 2] = p[2 * numSamples] * scaleZ;
+    }
+    for (size_t i = 0; i < numCFs; ++i) {
+      const float* pi = &positions[3 * i];
+      for (size_t j = i + 1; j < numCFs; ++j) {
+        const float* pj = &positions[3 * j];
+        float d[3] = {pj[0] - pi[0], pj[1] - pi[1], pj[2] - pi[2]};
+        float distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        size_t& k = open[i * numCFs + j];
+        if (!(distance < threshold)) {
+          k = SIZE_MAX;
+          continue;
+        }
+        double t = std::min(s * sampleTime, duration);
+        if (k == SIZE_MAX) {
+          k = collisions.size();
+          collisions.push_back(Collision{i, j, t, t, t, 0});
+          closest.push_back(distance / threshold);
+        } else if (distance / threshold < closest[k]) {
+          closest[k] = distance / threshold;
+          collisions[k].time = t;
+        }
+        collisions[k].end = t;
+      }
+    }
+  }
+  for (size_t k = 0; k < collisions.size(); ++k) {
+    collisions[k].distance = std::sqrt(closest[k]);
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+static double benchmarkChecker(
+  const PiecewiseBatch& trajectories,
+  double radiusXY,
+  double radiusZ,
+  double sampleTime,
+  double duration,
+  size_t numThreads,
+  std::vector<Collision>& collisions)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  CollisionChecker::check(trajectories, radiusXY, radiusZ, sampleTime, collisions, numThreads, duration);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+static bool operator<(const Collision& a, const Collision& b)
+{
+  return std::make_tuple(a.first, a.second, a.start) < std::make_tuple(b.first, b.second, b.start);
+}
+
+int main(int argc, char **argv)
+{
+  size_t numCFs;
+  double spacing;
+  double amplitude;
+  double radiusXY;
+  double radiusZ;
+  double sampleTime;
+  size_t numThreads;
+
+  namespace po = boost::program_options;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("cfs", po::value<size_t>(&numCFs)->default_value(500), "number of CFs (on a square grid)")
+    ("spacing", po::value<double>(&spacing)->default_value(0.5), "m, of the grid")
+    ("amplitude", po::value<double>(&amplitude)->default_value(0.3), "m, of the random coefficients")
+    ("radius-xy", po::value<double>(&radiusXY)->default_value(0.12), "m")
+    ("radius-z", po::value<double>(&radiusZ)->default_value(0.3), "m")
+    ("sample-time", po::value<double>(&sampleTime)->default_value(0.01), "s")
+    ("threads", po::value<size_t>(&numThreads)->default_value(1), "threads of the collision checker (0: all cores)")
+  ;
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  }
+  catch(po::error& e)
+  {
+    std::cerr << e.what() << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  std::mt19937 generator(42);
+  PiecewiseBatch trajectories;
+  size_t columns = (size_t)std::ceil(std::sqrt((double)numCFs));
+  double duration = 0;
+  for (size_t i = 0; i < numCFs; ++i) {
+    std::vector<float> pieces;
+    randomPieces(generator, 10, amplitude, pieces);
+    size_t index = trajectories.add(pieces.data(), pieces.size(), 1.0,
+      (i % columns) * spacing, (i / columns) * spacing, 1.0);
+    duration = std::max<double>(duration, trajectories.duration(index));
+  }
+
+  std::vector<Collision> bruteForce;
+  std::vector<Collision> checked;
+  double bruteForceTime = benchmarkBruteForce(trajectories, radiusXY, radiusZ, sampleTime, duration, bruteForce);
+  double checkerTime = benchmarkChecker(trajectories, radiusXY, radiusZ, sampleTime, duration, numThreads, checked);
+
+  std::sort(bruteForce.begin(), bruteForce.end());
+  std::sort(checked.begin(), checked.end());
+  size_t numMismatches = 0;
+  for (size_t k = 0; k < std::max(bruteForce.size(), checked.size()); ++k) {
+    if (k >= bruteForce.size() || k >= checked.size()
+        || bruteForce[k].first != checked[k].first || bruteForce[k].second != checked[k].second
+        || bruteForce[k].start != checked[k].start || bruteForce[k].end != checked[k].end
+        || bruteForce[k].time != checked[k].time
+        || std::abs(bruteForce[k].distance - checked[k].distance) > 1e-6) {
+      ++numMismatches;
+    }
+  }
+
+  std::cout << "CFs: " << numCFs << ", samples: " << (size_t)std::ceil(duration / sampleTime) + 1
+            << ", threads: " << numThreads << std::endl;
+  std::cout << "brute force: " << bruteForceTime * 1e3 << " ms (" << bruteForce.size() << " collisions)" << std::endl;
+  std::cout << "checker:     " << checkerTime * 1e3 << " ms (" << checked.size() << " collisions)" << std::endl;
+  std::cout << "speedup: " << bruteForceTime / checkerTime << std::endl;
+  std::cout << "mismatches: " << numMismatches << std::endl;
+
+  return numMismatches == 0 ? 0 : 1;
+}
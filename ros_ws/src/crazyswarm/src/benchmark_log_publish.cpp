@@ -0,0 +1,102 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include <ros/serialization.h>
+#include "crazyflie_driver/GenericLogData.h"
+
+// Compares the log publishing path of crazyswarm_server before and after
+// reusing the per-block GenericLogData message. Both variants serialize the
+// message, which is what ros::Publisher::publish does for remote subscribers.
+
+static double benchmarkFreshMessage(
+  const std::vector<double>& values,
+  size_t iterations,
+  size_t& bytes)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    crazyflie_driver::GenericLogData msg;
+    msg.header.stamp = ros::Time(i / 1000.0);
+    msg.values = values;
+    ros::SerializedMessage m = ros::serialization::serializeMessage(msg);
+    bytes += m.num_bytes;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+static double benchmarkReusedMessage(
+  const std::vector<double>& values,
+  size_t iterations,
+  size_t& bytes)
+{
+  crazyflie_driver::GenericLogDataPtr msg(new crazyflie_driver::GenericLogData);
+  msg->values.reserve(values.size());
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (!msg.unique()) {
+      msg.reset(new crazyflie_driver::GenericLogData);
+    }
+    msg->header.stamp = ros::Time(i / 1000.0);
+    msg->values.assign(values.begin(), values.end());
+    ros::SerializedMessage m = ros::serialization::serializeMessage(*msg);
+    bytes += m.num_bytes;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+  size_t numVariables;
+  size_t iterations;
+
+  namespace po = boost::program_options;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("variables", po::value<size_t>(&numVariables)->default_value(6), "number of variables per log block")
+    ("iterations", po::value<size_t>(&iterations)->default_value(1000000), "number of log packets")
+  ;
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  }
+  catch(po::error& e)
+  {
+    std::cerr << e.what() << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  std::vector<double> values(numVariables);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = 0.1 * i;
+  }
+
+  size_t bytesFresh = 0;
+  size_t bytesReused = 0;
+  double fresh = benchmarkFreshMessage(values, iterations, bytesFresh);
+  double reused = benchmarkReusedMessage(values, iterations, bytesReused);
+
+  std::cout << "variables: " << numVariables << ", packets: " << iterations << std::endl;
+  std::cout << "fresh message:  " << fresh / iterations * 1e9 << " ns/packet (" << bytesFresh << " bytes)" << std::endl;
+  std::cout << "reused message: " << reused / iterations * 1e9 << " ns/packet (" << bytesReused << " bytes)" << std::endl;
+  std::cout << "speedup: " << fresh / reused << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "piecewise_batch.h"
+
+// Compares PiecewiseBatch::evaluate with a scalar loop that evaluates one
+// trajectory at one time per call (as the firmware's piecewise_eval does),
+// on random trajectories, and reports the largest difference of the results.
+// Build with -DCMAKE_BUILD_TYPE=Release (or -O3 -march=native, as ppbatch).
+
+static const size_t PieceSize = PiecewiseBatch::PieceSize;
+
+static void randomPieces(
+  std::mt19937& generator,
+  size_t numPieces,
+  std::vector<float>& pieces)
+{
+  std::uniform_real_distribution<float> duration(0.5, 1.5);
+  std::uniform_real_distribution<float> coefficient(-1, 1);
+  pieces.resize(numPieces * PieceSize);
+  for (size_t i = 0; i < numPieces; ++i) {
+    pieces[i * PieceSize] = duration(generator);
+    for (size_t k = 1; k < PieceSize; ++k) {
+      pieces[i * PieceSize + k] = coefficient(generator);
+    }
+  }
+}
+
+// output: as PiecewiseBatch::evaluate (timescale 1, no shift)
+static double benchmarkScalar(
+  const std::vector<std::vector<float> >& trajectories,
+  const std::vector<float>& times,
+  size_t derivatives,
+  std::vector<float>& output)
+{
+  const size_t NumAxes = PiecewiseBatch::NumAxes;
+  const size_t NumCoefficients = PiecewiseBatch::NumCoefficients;
+  size_t numTimes = times.size();
+  output.assign(trajectories.size() * (derivatives + 1) * NumAxes * numTimes, 0);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (size_t index = 0; index < trajectories.size(); ++index) {
+    const std::vector<float>& pieces = trajectories[index];
+    size_t numPieces = pieces.size() / PieceSize;
+    float* y = &output[index * (derivatives + 1) * NumAxes * numTimes];
+    for (size_t s = 0; s < numTimes; ++s) {
+      // find the piece from the start of the trajectory
+      float t = times[s];
+      bool hold = t < 0;
+      size_t piece = 0;
+      float tau = std::max(t, 0.0f);
+      while (tau > pieces[piece * PieceSize]) {
+        if (piece + 1 == numPieces) {
+          hold = true;
+          tau = pieces[piece * PieceSize];
+          break;
+        }
+        tau -= pieces[piece * PieceSize];
+        ++piece;
+      }
+      const float* p = &pieces[piece * PieceSize + 1];
+      for (size_t d = 0; d <= derivatives; ++d) {
+        for (size_t axis = 0; axis < NumAxes; ++axis) {
+          float value = 0;
+          if (d == 0 || !hold) {
+            for (int k = NumCoefficients - 1; k >= (int)d; --k) {
+              float factor = 1;
+              for (size_t j = 0; j < d; ++j) {
+                factor *= k - j;
+              }
+              value = value * tau + p[axis * NumCoefficients + k] * factor;
+            }
+          }
+          y[(d * NumAxes + axis) * numTimes + s] = value;
+        }
+      }
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+static double benchmarkBatch(
+  const PiecewiseBatch& batch,
+  const std::vector<float>& times,
+  size_t derivatives,
+  size_t numThreads,
+  std::vector<float>& output)
+{
+  output.resize(batch.outputSizeFor(times.size(), derivatives));
+  auto start = std::chrono::high_resolution_clock::now();
+  batch.evaluate(times.data(), times.size(), derivatives, output.data(), output.size(), numThreads);
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double> elapsed = end - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv)
+{
+  size_t numTrajectories;
+  size_t numPieces;
+  size_t numTimes;
+  size_t derivatives;
+  size_t numThreads;
+
+  namespace po = boost::program_options;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", "produce help message")
+    ("cfs", po::value<size_t>(&numTrajectories)->default_value(100), "number of trajectories")
+    ("pieces", po::value<size_t>(&numPieces)->default_value(10), "pieces per trajectory")
+    ("samples", po::value<size_t>(&numTimes)->default_value(6000), "times per trajectory")
+    ("derivatives", po::value<size_t>(&derivatives)->default_value(2), "derivatives (at most 4)")
+    ("threads", po::value<size_t>(&numThreads)->default_value(1), "threads of the batch evaluation (0: all cores)")
+  ;
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << "\n";
+      return 0;
+    }
+  }
+  catch(po::error& e)
+  {
+    std::cerr << e.what() << std::endl << std::endl;
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  std::mt19937 generator(42);
+  std::vector<std::vector<float> > trajectories(numTrajectories);
+  PiecewiseBatch batch;
+  double duration = 0;
+  for (auto& pieces : trajectories) {
+    randomPieces(generator, numPieces, pieces);
+    size_t index = batch.add(pieces.data(), pieces.size());
+    duration = std::max<double>(duration, batch.duration(index));
+  }
+  // increasing times over the whole trajectories, and a bit beyond
+  std::vector<float> times(numTimes);
+  for (size_t s = 0; s < numTimes; ++s) {
+    times[s] = 1.1 * duration * s / numTimes;
+  }
+
+  std::vector<float> scalarOutput;
+  std::vector<float> batchOutput;
+  double scalar = benchmarkScalar(trajectories, times, derivatives, scalarOutput);
+  double batched = benchmarkBatch(batch, times, derivatives, numThreads, batchOutput);
+
+  double maxError = 0;
+  double maxValue = 0;
+  for (size_t i = 0; i < batchOutput.size(); ++i) {
+    maxError = std::max<double>(maxError, std::abs(batchOutput[i] - scalarOutput[i]));
+    maxValue = std::max<double>(maxValue, std::abs(scalarOutput[i]));
+  }
+
+  std::cout << "trajectories: " << numTrajectories << ", times: " << numTimes
+            << ", derivatives: " << derivatives << ", threads: " << numThreads << std::endl;
+  std::cout << "scalar: " << scalar * 1e3 << " ms" << std::endl;
+  std::cout << "batch:  " << batched * 1e3 << " ms" << std::endl;
+  std::cout << "speedup: " << scalar / batched << std::endl;
+  std::cout << "max. difference: " << maxError << " (max. value " << maxValue << ")" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Broadcast command scheduler (one per radio)
+ * Broadcasts are not acknowledged, so each command (takeoff, land, ...) is repeated. Instead of
+   blocking the caller for a fixed number of repeats, commands are queued and the repeats are
+   sent by the fast loop, a few per frame, between the pose broadcasts.
+ * The first copy is sent by the scheduler's own thread at a given start time. Commands for the
+   whole swarm use the same start time on all radios, so that the radios send concurrently.
+ * A command stops being repeated as soon as
+   - all CFs confirmed the command (e.g., a logged counter of received commands increased),
+   - the estimated probability that all (unconfirmed) CFs received at least one copy reaches the
+     confidence target, assuming independent losses with the current link quality,
+   - its deadline passed, or the maximum number of repeats was sent, or
+   - a newer command for an overlapping group mask was scheduled (which replaces it). Commands
+     scheduled with replaceable = false (e.g., parameter writes) neither replace others nor are
+     replaced.
+ * close() (e.g., in an emergency) drops the pending commands and refuses all later ones; their
+   futures report std::future_errc::broken_promise.
+ * Delivery statistics of finished commands are reported by the scheduler's thread. The same
+   thread sends the repeats if the fast loop stalls (e.g., no motion capture frames).
+*/
+
+class BroadcastScheduler
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+  struct Settings
+  {
+    size_t maxRepeats;
+    size_t repeatsPerFrame;
+    double deadline;    // seconds
+    double confidence;  // target probability that all CFs received the command
+  };
+
+  struct Stats
+  {
+    std::string name;
+    size_t repeats;
+    double elapsed;
+    size_t numCFs;
+    int confirmed;     // -1 if the CFs do not report received commands
+    double confidence;
+    std::string reason;
+  };
+
+  // Returns the number of CFs that confirmed the command, or -1 if unknown
+  typedef std::function<int()> Confirmation;
+
+  BroadcastScheduler(
+    const Settings& settings,
+    std::function<void(const Stats&)> report)
+    : m_settings(settings)
+    , m_report(report)
+    , m_mutex()
+    , m_pending()
+    , m_finished()
+    , m_lastRun(clock::now())
+    , m_linkQuality(0.5)
+    , m_cv()
+    , m_stop(false)
+    , m_closed(false)
+    , m_thread(&BroadcastScheduler::dispatch, this)
+  {
+  }
+
+  ~BroadcastScheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+  }
+
+  // The first copy is sent at startTime; the repeats are sent by run().
+  // The returned future is the time the first copy was actually sent (broken
+  // if the command is dropped before, see close()).
+  std::future<clock::time_point> schedule(
+    const std::string& name,
+    uint8_t groupMask,
+    size_t numCFs,
+    std::function<void()> send,
+    Confirmation confirmation,
+    clock::time_point startTime,
+    bool replaceable = true)
+  {
+    std::future<clock::time_point> result;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto now = clock::now();
+      if (m_closed) {
+        Command command{name, groupMask, numCFs, send, confirmation, startTime, 0, -1, 0,
+          false, replaceable, nullptr};
+        finish(command, now, "closed");
+        std::promise<clock::time_point> refused;
+        result = refused.get_future();
+        refused.set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        return result;
+      }
+      for (auto iter = m_pending.begin(); iter != m_pending.end() && replaceable;) {
+        if (iter->replaceable && (groupMask == 0 || iter->groupMask == 0 || (groupMask & iter->groupMask))) {
+          finish(*iter, now, "superseded");
+          iter = m_pending.erase(iter);
+        } else {
+          ++iter;
+        }
+      }
+
+      Command command{name, groupMask, numCFs, send, confirmation, startTime, 0, -1, 0,
+        false, replaceable, std::make_shared<std::promise<clock::time_point> >()};
+      result = command.sent->get_future();
+      m_pending.push_back(command);
+    }
+    m_cv.notify_all();
+    return result;
+  }
+
+  // Called once per frame of the fast loop, with the estimated probability
+  // that a single broadcast packet reaches a CF.
+  void run(
+    double linkQuality)
+  {
+    bool finished;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_linkQuality = linkQuality;
+      runLocked();
+      finished = !m_finished.empty();
+    }
+    if (finished) {
+      m_cv.notify_all();
+    }
+  }
+
+  // Drops all pending commands and refuses all later ones (e.g., in an emergency)
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+      auto now = clock::now();
+      for (const auto& command : m_pending) {
+        finish(command, now, "cancelled");
+      }
+      m_pending.clear();
+    }
+    m_cv.notify_all();
+  }
+
+  // Used if the fast loop stalls
+  void setLinkQuality(
+    double linkQuality)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_linkQuality = linkQuality;
+  }
+
+  static std::string format(const Stats& stats)
+  {
+    std::stringstream sstr;
+    sstr << stats.name << ": " << stats.repeats << " repeats in "
+         << std::fixed << std::setprecision(3) << stats.elapsed << " s";
+    if (stats.confirmed >= 0) {
+      sstr << ", " << stats.confirmed << "/" << stats.numCFs << " CFs confirmed";
+    }
+    sstr << ", confidence " << std::setprecision(4) << stats.confidence
+         << " (" << stats.reason << ")";
+    return sstr.str();
+  }
+
+private:
+  struct Command
+  {
+    std::string name;
+    uint8_t groupMask;
+    size_t numCFs;
+    std::function<void()> send;
+    Confirmation confirmation;
+    clock::time_point start;
+    size_t repeats;
+    int confirmed;
+    double confidence;
+    bool started;
+    bool replaceable;
+    std::shared_ptr<std::promise<clock::time_point> > sent;
+  };
+
+  // Sends the first copy of each command at its start time, sends the repeats
+  // if the fast loop stalls, and reports finished commands
+  void dispatch()
+  {
+    const auto stallTimeout = std::chrono::milliseconds(20);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+      if (!m_finished.empty()) {
+        std::vector<Stats> finished;
+        finished.swap(m_finished);
+        lock.unlock();
+        for (const auto& stats : finished) {
+          m_report(stats);
+        }
+        lock.lock();
+        continue;
+      }
+
+      auto now = clock::now();
+      auto next = m_pending.end();
+      bool started = false;
+      for (auto iter = m_pending.begin(); iter != m_pending.end(); ++iter) {
+        if (!iter->started && (next == m_pending.end() || iter->start < next->start)) {
+          next = iter;
+        }
+        started |= iter->started;
+      }
+      if (next != m_pending.end() && now >= next->start) {
+        next->send();
+        next->start = clock::now();
+        next->repeats = 1;
+        next->started = true;
+        next->sent->set_value(next->start);
+        continue;
+      }
+      if (started && now - m_lastRun >= stallTimeout) {
+        runLocked();
+        continue;
+      }
+
+      // wakes up early if a command was added, replaced or finished
+      if (started) {
+        auto wakeUp = m_lastRun + stallTimeout;
+        if (next != m_pending.end()) {
+          wakeUp = std::min(wakeUp, next->start);
+        }
+        m_cv.wait_until(lock, wakeUp);
+      } else if (next != m_pending.end()) {
+        m_cv.wait_until(lock, next->start);
+      } else {
+        m_cv.wait(lock);
+      }
+    }
+  }
+
+  void runLocked()
+  {
+    auto now = clock::now();
+    m_lastRun = now;
+
+    for (auto iter = m_pending.begin(); iter != m_pending.end();) {
+      const char* reason = iter->started ? update(*iter, now, m_linkQuality) : nullptr;
+      if (reason) {
+        finish(*iter, now, reason);
+        iter = m_pending.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+
+    // round-robin over the pending commands, oldest first
+    size_t budget = m_settings.repeatsPerFrame;
+    while (budget > 0 && !m_pending.empty()) {
+      size_t sent = 0;
+      for (auto& command : m_pending) {
+        if (budget > 0 && command.started && command.repeats < m_settings.maxRepeats) {
+          command.send();
+          ++command.repeats;
+          --budget;
+          ++sent;
+        }
+      }
+      if (sent == 0) {
+        break;
+      }
+    }
+  }
+
+  // Returns the reason to stop repeating the command, or nullptr
+  const char* update(Command& command, clock::time_point now, double linkQuality)
+  {
+    command.confirmed = command.confirmation ? command.confirmation() : -1;
+    size_t unconfirmed = command.numCFs - std::min<size_t>(std::max(command.confirmed, 0), command.numCFs);
+    double missed = std::pow(1.0 - linkQuality, command.repeats);
+    command.confidence = std::pow(1.0 - missed, unconfirmed);
+
+    std::chrono::duration<double> elapsed = now - command.start;
+    if (command.confirmed >= 0 && unconfirmed == 0) {
+      return "confirmed";
+    }
+    if (command.confidence >= m_settings.confidence) {
+      return "confidence target";
+    }
+    if (elapsed.count() >= m_settings.deadline) {
+      return "deadline";
+    }
+    if (command.repeats >= m_settings.maxRepeats) {
+      return "max repeats";
+    }
+    return nullptr;
+  }
+
+  void finish(const Command& command, clock::time_point now, const char* reason)
+  {
+    // a command that was replaced before its start time was never sent
+    std::chrono::duration<double> elapsed = command.started ? now - command.start : clock::duration::zero();
+    m_finished.push_back({command.name, command.repeats, elapsed.count(),
+      command.numCFs, command.confirmed, command.confidence, reason});
+  }
+
+  Settings m_settings;
+  std::function<void(const Stats&)> m_report;
+  std::mutex m_mutex;
+  std::list<Command> m_pending;
+  std::vector<Stats> m_finished;
+  clock::time_point m_lastRun;
+  double m_linkQuality;
+  std::condition_variable m_cv;
+  bool m_stop;
+  bool m_closed;
+  std::thread m_thread;
+};
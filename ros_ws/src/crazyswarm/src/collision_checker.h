@@ -0,0 +1,279 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "parallel_for.h"
+#include "piecewise_batch.h"
+
+/*
+Collisions between the planned trajectories of a swarm
+ * Two CFs collide if sqrt((dx^2 + dy^2) / radiusXY^2 + dz^2 / radiusZ^2) < 1, i.e., the ellipsoid
+   is elongated in z for the downwash (e.g., 0.12 m in x/y and 0.3 m in z).
+ * All trajectories are sampled every sampleTime seconds (positions only, including the shift).
+   Each time slice puts the CFs into a uniform spatial hash in the space where z is scaled by
+   radiusXY / radiusZ. Cells are 2 radiusXY wide, so that the CFs closer than radiusXY to a CF
+   are in the 8 cells around the corner of its cell nearest to it; only those pairs are tested.
+ * Time slices are spread over threads in blocks of PiecewiseBatch::BlockSize. Consecutive
+   samples of a pair are merged into one collision.
+ * Collisions shorter than sampleTime can be missed; with relative speeds up to v, sample at most
+   every margin / v seconds.
+*/
+
+struct Collision
+{
+  size_t first;      // trajectory indices, first < second
+  size_t second;
+  double start;      // s, first and last sample in collision
+  double end;
+  double time;       // s, closest approach
+  double distance;   // ellipsoidal distance at the closest approach (< 1)
+};
+
+class CollisionChecker
+{
+public:
+  // duration: of the plan (0: longest trajectory); numThreads = 0: all cores
+  static void check(
+    const PiecewiseBatch& trajectories,
+    double radiusXY,
+    double radiusZ,
+    double sampleTime,
+    std::vector<Collision>& collisions,
+    size_t numThreads = 1,
+    double duration = 0)
+  {
+    if (!(radiusXY > 0 && radiusZ > 0)) {
+      throw std::runtime_error("radii have to be positive");
+    }
+    if (!(sampleTime > 0)) {
+      throw std::runtime_error("sampleTime has to be positive");
+    }
+    collisions.clear();
+    if (duration <= 0) {
+      for (size_t i = 0; i < trajectories.size(); ++i) {
+        duration = std::max(duration, (double)trajectories.duration(i));
+      }
+    }
+    if (trajectories.size() < 2) {
+      return;
+    }
+    const size_t BlockSize = PiecewiseBatch::BlockSize;
+    size_t numSamples = (size_t)std::ceil(duration / sampleTime) + 1;
+    size_t numBlocks = (numSamples + BlockSize - 1) / BlockSize;
+    numThreads = threadCount(numThreads, numBlocks);
+
+    std::vector<std::vector<Interval> > results(numBlocks);
+    auto work = [&](size_t thread) {
+      Slice slice(trajectories.size(), radiusXY, radiusZ);
+      for (size_t block = thread; block < numBlocks; block += numThreads) {
+        checkBlock(trajectories, block * BlockSize, std::min(numSamples - block * BlockSize, BlockSize),
+          sampleTime, duration, slice, results[block]);
+      }
+    };
+    parallelFor(numThreads, numThreads, work);
+
+    // merge intervals that continue in the next block
+    std::vector<Interval> intervals;
+    for (const auto& result : results) {
+      intervals.insert(intervals.end(), result.begin(), result.end());
+    }
+    std::sort(intervals.begin(), intervals.end());
+    for (size_t i = 0; i < intervals.size();) {
+      Interval merged = intervals[i];
+      for (++i; i < intervals.size() && intervals[i].first == merged.first && intervals[i].second == merged.second
+          && intervals[i].start == merged.end + 1; ++i) {
+        merged.end = intervals[i].end;
+        if (intervals[i].distance < merged.distance) {
+          merged.distance = intervals[i].distance;
+          merged.closest = intervals[i].closest;
+        }
+      }
+      Collision collision;
+      collision.first = merged.first;
+      collision.second = merged.second;
+      collision.start = sampleTimeAt(merged.start, sampleTime, duration);
+      collision.end = sampleTimeAt(merged.end, sampleTime, duration);
+      collision.time = sampleTimeAt(merged.closest, sampleTime, duration);
+      collision.distance = std::sqrt(merged.distance);
+      collisions.push_back(collision);
+    }
+  }
+
+private:
+  // samples of a pair in collision
+  struct Interval
+  {
+    uint32_t first;
+    uint32_t second;
+    uint32_t start;
+    uint32_t end;
+    uint32_t closest;
+    float distance;   // squared
+
+    bool operator<(const Interval& other) const {
+      if (first != other.first) {
+        return first < other.first;
+      }
+      if (second != other.second) {
+        return second < other.second;
+      }
+      return start < other.start;
+    }
+  };
+
+  // Spatial hash of the CFs at one time: cells are counting-sorted into buckets
+  struct Slice
+  {
+    Slice(size_t numCFs, double radiusXY, double radiusZ)
+      : positions(3 * numCFs)
+      , cells(3 * numCFs)
+      , directions(3 * numCFs)
+      , buckets(numCFs)
+      , bucketStart()
+      , entries(numCFs)
+      , visited()
+      , stamp(0)
+      , mask(1)
+      , radius(radiusXY)
+      , scaleZ(radiusXY / radiusZ)
+    {
+      while (mask + 1 < 2 * numCFs) {
+        mask = 2 * mask + 1;
+      }
+      bucketStart.resize(mask + 2);
+      visited.resize(mask + 1, 0);
+    }
+
+    uint32_t bucket(int32_t x, int32_t y, int32_t z) const {
+      return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u) & mask;
+    }
+
+    std::vector<float> positions;     // CF x axis, z scaled
+    std::vector<int32_t> cells;       // CF x axis
+    std::vector<int8_t> directions;   // CF x axis
+    std::vector<uint32_t> buckets;    // per CF
+    std::vector<uint32_t> bucketStart;
+    std::vector<uint32_t> entries;    // CFs sorted by bucket
+    std::vector<uint32_t> visited;    // per bucket: stamp of the last query
+    uint32_t stamp;
+    uint32_t mask;
+    float radius;
+    float scaleZ;
+  };
+
+  static double sampleTimeAt(size_t sample, double sampleTime, double duration) {
+    return std::min(sample * sampleTime, duration);
+  }
+
+  static void checkBlock(
+    const PiecewiseBatch& trajectories,
+    size_t first,
+    size_t n,
+    double sampleTime,
+    double duration,
+    Slice& slice,
+    std::vector<Interval>& intervals)
+  {
+    const size_t BlockSize = PiecewiseBatch::BlockSize;
+    const size_t NumAxes = PiecewiseBatch::NumAxes;
+    const size_t numCFs = trajectories.size();
+
+    float times[BlockSize];
+    for (size_t s = 0; s < n; ++s) {
+      times[s] = sampleTimeAt(first + s, sampleTime, duration);
+    }
+    std::vector<float> output(numCFs * NumAxes * BlockSize);
+    for (size_t i = 0; i < numCFs; ++i) {
+      trajectories.evaluateBlock(i, times, n, 0, &output[i * NumAxes * BlockSize], BlockSize);
+    }
+
+    std::vector<Interval> hits;
+    const float inverseCellSize = 0.5f / slice.radius;
+    const float threshold = slice.radius * slice.radius;
+    for (size_t s = 0; s < n; ++s) {
+      // cells and buckets (counting sort)
+      std::fill(slice.bucketStart.begin(), slice.bucketStart.end(), 0);
+      for (size_t i = 0; i < numCFs; ++i) {
+        const float* p = &output[i * NumAxes * BlockSize + s];
+        float* q = &slice.positions[3 * i];
+        q[0] = p[0];
+        q[1] = p[BlockSize];
+        q[2] = p[2 * BlockSize] * slice.scaleZ;
+        int32_t* c = &slice.cells[3 * i];
+        for (size_t axis = 0; axis < 3; ++axis) {
+          float cell = std::floor(q[axis] * inverseCellSize);
+          c[axis] = (int32_t)cell;
+          // neighbor cell towards the nearest corner (+1 / -1)
+          slice.directions[3 * i + axis] = q[axis] * inverseCellSize - cell < 0.5f ? -1 : 1;
+        }
+        slice.buckets[i] = slice.bucket(c[0], c[1], c[2]);
+        ++slice.bucketStart[slice.buckets[i] + 1];
+      }
+      for (size_t b = 1; b < slice.bucketStart.size(); ++b) {
+        slice.bucketStart[b] += slice.bucketStart[b - 1];
+      }
+      for (size_t i = 0; i < numCFs; ++i) {
+        slice.entries[slice.bucketStart[slice.buckets[i]]++] = i;
+      }
+      // bucketStart[b] is now the end of bucket b, i.e., the start of bucket b + 1
+      // pairs with CFs in the 8 cells around the nearest corner (each bucket once)
+      for (size_t i = 0; i < numCFs; ++i) {
+        const int32_t* c = &slice.cells[3 * i];
+        const int8_t* direction = &slice.directions[3 * i];
+        const float* pi = &slice.positions[3 * i];
+        if (++slice.stamp == 0) {
+          std::fill(slice.visited.begin(), slice.visited.end(), 0);
+          slice.stamp = 1;
+        }
+        for (int dx = 0; dx <= 1; ++dx) {
+          for (int dy = 0; dy <= 1; ++dy) {
+            for (int dz = 0; dz <= 1; ++dz) {
+              uint32_t b = slice.bucket(c[0] + dx * direction[0], c[1] + dy * direction[1], c[2] + dz * direction[2]);
+              if (slice.visited[b] == slice.stamp) {
+                continue;
+              }
+              slice.visited[b] = slice.stamp;
+              for (uint32_t k = b > 0 ? slice.bucketStart[b - 1] : 0; k < slice.bucketStart[b]; ++k) {
+                uint32_t j = slice.entries[k];
+                if (j <= i) {
+                  continue;
+                }
+                const float* pj = &slice.positions[3 * j];
+                float d[3] = {pj[0] - pi[0], pj[1] - pi[1], pj[2] - pi[2]};
+                float distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                if (distance < threshold) {
+                  Interval hit;
+                  hit.first = i;
+                  hit.second = j;
+                  hit.start = hit.end = hit.closest = first + s;
+                  hit.distance = distance / threshold;
+                  hits.push_back(hit);
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+
+    // consecutive samples of a pair
+    std::sort(hits.begin(), hits.end());
+    for (const auto& hit : hits) {
+      if (intervals.empty() || intervals.back().first != hit.first || intervals.back().second != hit.second
+          || intervals.back().end + 1 != hit.start) {
+        intervals.push_back(hit);
+        continue;
+      }
+      Interval& last = intervals.back();
+      last.end = hit.end;
+      if (hit.distance < last.distance) {
+        last.distance = hit.distance;
+        last.closest = hit.closest;
+      }
+    }
+  }
+};
@@ -23,6 +23,13 @@
 #include "sensor_msgs/Temperature.h"
 #include "sensor_msgs/MagneticField.h"
 #include "std_msgs/Float32.h"
+#include "crazyswarm/QueryTelemetry.h"
+#include "crazyswarm/AddCrazyflie.h"
+#include "crazyswarm/RemoveCrazyflie.h"
+#include "crazyswarm/ReplaceCrazyflie.h"
+#include "crazyswarm/UploadSwarmTrajectory.h"
+#include "crazyswarm/StreamTrajectory.h"
+#include "crazyswarm/UploadSwarmNN.h"
 
 #include <sensor_msgs/Joy.h>
 #include <sensor_msgs/PointCloud.h>
@@ -31,6 +38,8 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <exception>
 
 #include <crazyflie_cpp/Crazyflie.h>
 
@@ -58,6 +67,21 @@
 #include <mutex>
 #include <wordexp.h> // tilde expansion
 
+#include "log_bandwidth_planner.h"
+#include "parallel_for.h"
+#include "telemetry_store.h"
+#include "toc_cache.h"
+#include "swarm_config.h"
+#include "startup_tracer.h"
+#include "broadcast_scheduler.h"
+#include "trajectory_broadcaster.h"
+#include "trajectory_stream.h"
+#include "trajectory_encoding.h"
+#include "mapped_file.h"
+#include "nn_descriptor.h"
+#include "piecewise_batch.h"
+#include "trajectory_feasibility.h"
+
 /*
 Threading
  * There are 2N+1 threads, where N is the number of groups (== number of unique channels)
@@ -83,6 +107,80 @@ double radToDeg(double rad) {
     return rad * 180.0 / pi();
 }
 
+size_t logTypeSize(Crazyflie::LogType type)
+{
+  switch (type) {
+    case Crazyflie::LogTypeUint8:
+    case Crazyflie::LogTypeInt8:
+      return 1;
+    case Crazyflie::LogTypeUint16:
+    case Crazyflie::LogTypeInt16:
+    case Crazyflie::LogTypeFP16:
+      return 2;
+    case Crazyflie::LogTypeUint32:
+    case Crazyflie::LogTypeInt32:
+    case Crazyflie::LogTypeFloat:
+      return 4;
+  }
+  return 0;
+}
+
+// Calls f(group, name, value) for each entry of a firmware parameter table
+// ({group: {name: value}}, as in the YAML configuration)
+void forEachParamValue(
+  XmlRpc::XmlRpcValue params,
+  std::function<void(const std::string&, const std::string&, double)> f)
+{
+  if (params.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+    return;
+  }
+  for (auto iter = params.begin(); iter != params.end(); ++iter) {
+    const std::string& group = iter->first;
+    XmlRpc::XmlRpcValue& v = iter->second;
+    if (v.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+      continue;
+    }
+    for (auto iter2 = v.begin(); iter2 != v.end(); ++iter2) {
+      const std::string& name = iter2->first;
+      XmlRpc::XmlRpcValue& value = iter2->second;
+
+      if (value.getType() == XmlRpc::XmlRpcValue::TypeBoolean) {
+        f(group, name, (bool)value ? 1 : 0);
+      } else if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+        f(group, name, (int)value);
+      } else if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble) {
+        f(group, name, (double)value);
+      } else {
+        ROS_WARN("No known type for %s.%s!", group.c_str(), name.c_str());
+      }
+    }
+  }
+}
+
+// Converts the pieces of a trajectory message; false if a piece is malformed
+bool toPoly4d(
+  const std::vector<crazyflie_driver::TrajectoryPolynomialPiece>& msg,
+  std::vector<Crazyflie::poly4d>& pieces)
+{
+  pieces.resize(msg.size());
+  for (size_t i = 0; i < pieces.size(); ++i) {
+    if (   msg[i].poly_x.size() != 8
+        || msg[i].poly_y.size() != 8
+        || msg[i].poly_z.size() != 8
+        || msg[i].poly_yaw.size() != 8) {
+      return false;
+    }
+    pieces[i].duration = msg[i].duration.toSec();
+    for (size_t j = 0; j < 8; ++j) {
+      pieces[i].p[0][j] = msg[i].poly_x[j];
+      pieces[i].p[1][j] = msg[i].poly_y[j];
+      pieces[i].p[2][j] = msg[i].poly_z[j];
+      pieces[i].p[3][j] = msg[i].poly_yaw[j];
+    }
+  }
+  return true;
+}
+
 void logWarn(const std::string& msg)
 {
   ROS_WARN("%s", msg.c_str());
@@ -167,7 +265,11 @@ public:
     const std::string& type,
     const std::vector<crazyflie_driver::LogBlock>& log_blocks,
     ros::CallbackQueue& queue,
-    bool force_no_cache)
+    bool force_no_cache,
+    bool publish_shared_log_data,
+    TelemetryStore* telemetry,
+    TocCache* tocCache,
+    const FeasibilityChecker* feasibility)
     : m_tf_prefix(tf_prefix)
     , m_cf(
       link_uri,
@@ -188,7 +290,22 @@ public:
     , m_serviceUploadNN()
     , m_logBlocks(log_blocks)
     , m_forceNoCache(force_no_cache)
+    , m_publishSharedLogData(publish_shared_log_data)
+    , m_telemetry(telemetry)
+    , m_tocCache(tocCache)
+    , m_feasibility(feasibility)
+    , m_paramTocFingerprint(0)
+    , m_logTocFingerprint(0)
     , m_initializedPosition(false)
+    , m_minLinkQuality(1.0)
+    , m_linkQuality(1.0)
+    , m_groupMask(0)
+    , m_trajectories()
+    , m_trajectoryMutex()
+    , m_execution{-1, 1.0f, std::chrono::high_resolution_clock::time_point()}
+    , m_numCommands(0)
+    , m_nnHash(0)
+    , m_linkDown(false)
   {
     ros::NodeHandle n;
     n.setCallbackQueue(&queue);
@@ -202,8 +319,15 @@ public:
     if (m_enableLogging) {
       m_logFile.open("logcf" + std::to_string(id) + ".csv");
       m_logFile << "time,";
+      m_logPublishers.resize(m_logBlocks.size());
+      size_t i = 0;
       for (auto& logBlock : m_logBlocks) {
-        m_pubLogDataGeneric.push_back(n.advertise<crazyflie_driver::GenericLogData>(tf_prefix + "/" + logBlock.topic_name, 10));
+        m_logPublishers[i].pub = n.advertise<crazyflie_driver::GenericLogData>(tf_prefix + "/" + logBlock.topic_name, 10);
+        m_logPublishers[i].msg.reset(new crazyflie_driver::GenericLogData);
+        m_logPublishers[i].msg->values.reserve(logBlock.variables.size());
+        m_logPublishers[i].numReceived = 0;
+        m_logPublishers[i].telemetry = nullptr;
+        ++i;
         for (const auto& variableName : logBlock.variables) {
           m_logFile << variableName << ",";
         }
@@ -218,6 +342,11 @@ public:
   {
     m_logBlocks.clear();
     m_logBlocksGeneric.clear();
+    if (m_telemetry) {
+      for (const auto& publisher : m_logPublishers) {
+        m_telemetry->removeBlock(m_id, publisher.telemetry);
+      }
+    }
     // m_cf.sysoff();
     m_logFile.close();
   }
@@ -234,6 +363,19 @@ public:
     return m_type;
   }
 
+  float linkQuality() const {
+    return m_linkQuality;
+  }
+
+  uint8_t groupMask() const {
+    return m_groupMask;
+  }
+
+  // number of takeoff, land and goTo requests to this CF (ends its trajectory stream)
+  uint32_t numCommands() const {
+    return m_numCommands;
+  }
+
   void sendPing() {
     m_cf.sendPing();
   }
@@ -337,6 +479,83 @@ public:
     return true;
   }
 
+  // Sets the given firmware parameters ({group: {name: value}}, as in the YAML
+  // configuration) in one request. Later entries override earlier ones.
+  // Returns the number of values sent.
+  size_t applyFirmwareParams(
+    const std::vector<XmlRpc::XmlRpcValue>& firmwareParams)
+  {
+    size_t numParams = 0;
+    m_cf.startSetParamRequest();
+    for (const auto& params : firmwareParams) {
+      forEachParamValue(params, [&](const std::string& group, const std::string& name, double value) {
+        auto entry = m_cf.getParamTocEntry(group, name);
+        if (!entry) {
+          ROS_ERROR("Could not find param %s/%s", group.c_str(), name.c_str());
+          return;
+        }
+        std::cout << "update " << group + "/" + name << " to " << value << std::endl;
+        switch (entry->type) {
+          case Crazyflie::ParamTypeUint8:
+            m_cf.addSetParam<uint8_t>(entry->id, (uint8_t)value);
+            break;
+          case Crazyflie::ParamTypeInt8:
+            m_cf.addSetParam<int8_t>(entry->id, (int8_t)value);
+            break;
+          case Crazyflie::ParamTypeUint16:
+            m_cf.addSetParam<uint16_t>(entry->id, (uint16_t)value);
+            break;
+          case Crazyflie::ParamTypeInt16:
+            m_cf.addSetParam<int16_t>(entry->id, (int16_t)value);
+            break;
+          case Crazyflie::ParamTypeUint32:
+            m_cf.addSetParam<uint32_t>(entry->id, (uint32_t)value);
+            break;
+          case Crazyflie::ParamTypeInt32:
+            m_cf.addSetParam<int32_t>(entry->id, (int32_t)value);
+            break;
+          case Crazyflie::ParamTypeFloat:
+            m_cf.addSetParam<float>(entry->id, (float)value);
+            break;
+        }
+        mirrorParam(*entry, value);
+        ++numParams;
+      });
+    }
+    m_cf.setRequestedParams();
+    return numParams;
+  }
+
+  // Records parameter values that were set by other means (e.g., broadcast)
+  // and mirrors the affected parameter groups to the ROS parameter server.
+  void mirrorParams(
+    const XmlRpc::XmlRpcValue& params)
+  {
+    std::set<std::string> groups;
+    forEachParamValue(params, [&](const std::string& group, const std::string& name, double value) {
+      auto entry = m_cf.getParamTocEntry(group, name);
+      if (entry) {
+        mirrorParam(*entry, value);
+        groups.insert(group);
+      }
+    });
+    for (const auto& group : groups) {
+      ros::param::set("/" + m_tf_prefix + "/" + group, m_paramTable[group]);
+    }
+  }
+
+  // Mirrors all firmware parameters to the ROS parameter server (/<tf_prefix>/<group>/<name>),
+  // using one call per parameter group. Setting /<tf_prefix> itself would replace
+  // the other parameters in the namespace of the CF.
+  void publishParams()
+  {
+    if (m_paramTable.getType() != XmlRpc::XmlRpcValue::TypeStruct) {
+      return;
+    }
+    for (auto iter = m_paramTable.begin(); iter != m_paramTable.end(); ++iter) {
+      ros::param::set("/" + m_tf_prefix + "/" + iter->first, iter->second);
+    }
+  }
 
   bool uploadTrajectory(
     crazyflie_driver::UploadTrajectory::Request& req,
@@ -344,24 +563,12 @@ public:
   {
     ROS_INFO("[%s] Upload trajectory", m_frame.c_str());
 
-    std::vector<Crazyflie::poly4d> pieces(req.pieces.size());
-    for (size_t i = 0; i < pieces.size(); ++i) {
-      if (   req.pieces[i].poly_x.size() != 8
-          || req.pieces[i].poly_y.size() != 8
-          || req.pieces[i].poly_z.size() != 8
-          || req.pieces[i].poly_yaw.size() != 8) {
-        ROS_FATAL("Wrong number of pieces!");
-        return false;
-      }
-      pieces[i].duration = req.pieces[i].duration.toSec();
-      for (size_t j = 0; j < 8; ++j) {
-        pieces[i].p[0][j] = req.pieces[i].poly_x[j];
-        pieces[i].p[1][j] = req.pieces[i].poly_y[j];
-        pieces[i].p[2][j] = req.pieces[i].poly_z[j];
-        pieces[i].p[3][j] = req.pieces[i].poly_yaw[j];
-      }
+    std::vector<Crazyflie::poly4d> pieces;
+    if (!toPoly4d(req.pieces, pieces)) {
+      ROS_FATAL("Wrong number of pieces!");
+      return false;
     }
-    m_cf.uploadTrajectory(req.trajectoryId, req.pieceOffset, pieces);
+    uploadTrajectory(req.trajectoryId, req.pieceOffset, pieces, false);
 
     ROS_INFO("[%s] Uploaded trajectory", m_frame.c_str());
 
@@ -369,6 +576,151 @@ public:
     return true;
   }
 
+  // Returns false (and does not upload) if skipIfUploaded is set and this server
+  // already uploaded the same trajectory (id, offset and content) to the CF.
+  bool uploadTrajectory(
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    bool skipIfUploaded)
+  {
+    if (skipIfUploaded && hasTrajectory(trajectoryId, pieceOffset, pieces)) {
+      return false;
+    }
+    forgetTrajectories(trajectoryId, pieceOffset, pieces.size());
+    auto start = std::chrono::high_resolution_clock::now();
+    m_cf.uploadTrajectory(trajectoryId, pieceOffset, pieces);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    recordTrajectory(trajectoryId, pieceOffset, pieces);
+    ROS_INFO("[%s] Trajectory %d: %zu pieces, %zu B in %.3f s", m_frame.c_str(), trajectoryId,
+      pieces.size(), TrajectoryEncoding::rawSize(pieces.size()), elapsed.count());
+    return true;
+  }
+
+  bool hasTrajectory(
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    const std::vector<Crazyflie::poly4d>& pieces) const
+  {
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    auto iter = m_trajectories.find(trajectoryId);
+    return iter != m_trajectories.end() && iter->second.hash == trajectoryHash(pieceOffset, pieces);
+  }
+
+  // Fastest feasible timescale of an uploaded trajectory for the limits of this
+  // CF's type (0: unknown or no limits). Thread-safe.
+  double minTimescale(
+    uint8_t trajectoryId) const
+  {
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    auto iter = m_trajectories.find(trajectoryId);
+    return iter != m_trajectories.end() ? iter->second.minTimescale : 0;
+  }
+
+  // Trajectories in the part of the memory that is (or was) overwritten
+  void forgetTrajectories(
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    size_t numPieces)
+  {
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    forgetTrajectoriesLocked(trajectoryId, pieceOffset, numPieces);
+  }
+
+  // All trajectories and the NN, e.g., if the CF may have rebooted. Thread-safe.
+  void forgetUploads()
+  {
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    m_trajectories.clear();
+    m_nnHash = 0;
+  }
+
+  // After an upload (also by broadcast, see TrajectoryBroadcaster)
+  void recordTrajectory(
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    const std::vector<Crazyflie::poly4d>& pieces)
+  {
+    float minTimescale = m_feasibility ? m_feasibility->check(pieces, 1.0f, m_type).minTimescale : 0;
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    forgetTrajectoriesLocked(trajectoryId, pieceOffset, pieces.size());
+    m_trajectories[trajectoryId] = {pieceOffset, pieces.size(), trajectoryHash(pieceOffset, pieces),
+      trajectoryDuration(pieces), minTimescale};
+  }
+
+private:
+  void forgetTrajectoriesLocked(
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    size_t numPieces)
+  {
+    for (auto iter = m_trajectories.begin(); iter != m_trajectories.end();) {
+      const auto& t = iter->second;
+      if (iter->first == trajectoryId || (t.pieceOffset < pieceOffset + numPieces && pieceOffset < t.pieceOffset + t.numPieces)) {
+        iter = m_trajectories.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+public:
+  // Records the last high-level command that reached this CF (also by broadcast):
+  // the trajectory it flies from memory, or -1 (takeoff, land, stop, goTo).
+  // Thread-safe.
+  void setExecution(
+    int trajectoryId,
+    float timescale)
+  {
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    m_execution = {trajectoryId, timescale, std::chrono::high_resolution_clock::now()};
+  }
+
+  // True if the CF may still fly the given trajectory, or one stored in the given
+  // part of the trajectory memory. A trajectory without a record (e.g., because it
+  // was overwritten meanwhile) counts as flown until the next command.
+  bool isExecuting(
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    size_t numPieces) const
+  {
+    std::lock_guard<std::mutex> lock(m_trajectoryMutex);
+    const Execution& execution = m_execution;
+    if (execution.trajectoryId < 0) {
+      return false;
+    }
+    auto iter = m_trajectories.find(execution.trajectoryId);
+    if (iter == m_trajectories.end()) {
+      return true;
+    }
+    const auto& t = iter->second;
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - execution.start;
+    if (elapsed.count() > t.duration * execution.timescale) {
+      return false;
+    }
+    return execution.trajectoryId == trajectoryId
+      || (t.pieceOffset < pieceOffset + numPieces && pieceOffset < t.pieceOffset + t.numPieces);
+  }
+
+  // -1 if the CF has no trajectory memory (or the memory TOC was not requested)
+  int trajectoryMemoryId() const
+  {
+    for (auto iter = m_cf.memoriesBegin(); iter != m_cf.memoriesEnd(); ++iter) {
+      if (iter->type == Crazyflie::MemoryTypeTRAJ) {
+        return iter->id;
+      }
+    }
+    return -1;
+  }
+
+  void startTrajectory(
+    uint8_t trajectoryId,
+    float timescale)
+  {
+    m_cf.startTrajectory(trajectoryId, timescale, /*reversed*/ false, /*relative*/ false);
+    setExecution(trajectoryId, timescale);
+  }
+
   bool takeoff(
     crazyflie_driver::Takeoff::Request& req,
     crazyflie_driver::Takeoff::Response& res)
@@ -376,6 +728,8 @@ public:
     ROS_INFO("[%s] Takeoff", m_frame.c_str());
 
     m_cf.takeoff(req.height, req.duration.toSec(), req.groupMask);
+    setExecution(-1, 1.0f);
+    ++m_numCommands;
 
     return true;
   }
@@ -387,6 +741,8 @@ public:
     ROS_INFO("[%s] Land", m_frame.c_str());
 
     m_cf.land(req.height, req.duration.toSec(), req.groupMask);
+    setExecution(-1, 1.0f);
+    ++m_numCommands;
 
     return true;
   }
@@ -398,6 +754,8 @@ public:
     ROS_INFO("[%s] GoTo", m_frame.c_str());
 
     m_cf.goTo(req.goal.x, req.goal.y, req.goal.z, req.yaw, req.duration.toSec(), req.relative, req.groupMask);
+    setExecution(-1, 1.0f);
+    ++m_numCommands;
 
     return true;
   }
@@ -409,6 +767,7 @@ public:
     ROS_INFO("[%s] Set Group Mask", m_frame.c_str());
 
     m_cf.setGroupMask(req.groupMask);
+    m_groupMask = req.groupMask;
 
     return true;
   }
@@ -419,25 +778,78 @@ public:
   {
     ROS_INFO("[%s] Upload NN", m_frame.c_str());
 
-    std::ifstream file(req.filename, std::ios::binary | std::ios::ate);
-    std::ifstream::pos_type pos = file.tellg();
+    MappedFile file(req.filename);
+    if (!file.valid()) {
+      ROS_ERROR("[%s] Could not read NN: %s", m_frame.c_str(), file.error().c_str());
+      return false;
+    }
+    // the only copy (Crazyflie::uploadNN takes a vector)
+    std::vector<uint8_t> nnDesc(file.begin(), file.end());
+
+    double elapsed;
+    try {
+      elapsed = uploadNN(nnDesc, nnHash(nnDesc));
+    } catch (std::exception& e) {
+      ROS_ERROR("[%s] Could not upload NN: %s", m_frame.c_str(), e.what());
+      return false;
+    }
 
-    std::vector<uint8_t> nnDesc(pos);
-    file.seekg(0, std::ios::beg);
-    file.read(reinterpret_cast<char*>(nnDesc.data()), pos);
+    ROS_INFO("[%s] Uploaded NN (took %f s, %s)", m_frame.c_str(), elapsed, describeNN(nnDesc).c_str());
 
-    auto start = std::chrono::system_clock::now();
+    return true;
+  }
+
+  // Returns the upload time. Throws if the firmware cannot decode the descriptor.
+  double uploadNN(
+    const std::vector<uint8_t>& nnDesc,
+    uint64_t hash)
+  {
+    int version = NNDescriptor::version(nnDesc.data(), nnDesc.size());
+    if (version > 0) {
+      // the firmware reports the highest CFNN version it decodes (see NNDescriptor)
+      auto entry = m_cf.getParamTocEntry("ctrlNN", "cfnnVersion");
+      if (!entry || entry->type != Crazyflie::ParamTypeUint8) {
+        throw std::runtime_error("firmware does not decode CFNN descriptors (no param ctrlNN.cfnnVersion)");
+      }
+      int supported = m_cf.getParam<uint8_t>(entry->id);
+      if (supported < version) {
+        throw std::runtime_error("firmware decodes CFNN descriptors up to version " + std::to_string(supported)
+          + ", not " + std::to_string(version));
+      }
+    }
+    m_nnHash = 0;
+    auto start = std::chrono::high_resolution_clock::now();
     m_cf.uploadNN(nnDesc);
-    auto end = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsedSeconds = end-start;
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    m_nnHash = hash;
+    return elapsed.count();
+  }
 
-    ROS_INFO("[%s] Uploaded NN (took %f s)", m_frame.c_str(), elapsedSeconds.count());
+  // True if this server uploaded the NN with the given hash (forgotten if the link
+  // drops, see onLinkQuality)
+  bool hasNN(uint64_t hash) const {
+    return m_nnHash != 0 && m_nnHash == hash;
+  }
 
-    return true;
+  static uint64_t nnHash(const std::vector<uint8_t>& nnDesc) {
+    return TocCache::hash(nnDesc.data(), nnDesc.size());
+  }
+
+  // Layers and weight type (see NNDescriptor), or the size of an opaque descriptor
+  static std::string describeNN(const std::vector<uint8_t>& nnDesc)
+  {
+    NNDescriptor nn;
+    std::string message;
+    if (nn.parse(nnDesc.data(), nnDesc.size(), message)) {
+      return nn.summary();
+    }
+    return std::to_string(nnDesc.size()) + " B, " + message;
   }
 
   void run(
-    ros::CallbackQueue& queue)
+    ros::CallbackQueue& queue,
+    const LogBandwidthPlanner::Plan& logPlan,
+    const StartupTracer::Track& track)
   {
     // m_cf.reboot();
     // m_cf.syson();
@@ -453,31 +865,37 @@ public:
     if (m_enableParameters)
     {
       ROS_INFO("[%s] Requesting parameters...", m_frame.c_str());
-      m_cf.requestParamToc(m_forceNoCache);
+      auto scope = track.scope("paramTOC");
+      m_minLinkQuality = 1.0;
+      requestToc("param");
+      scope.arg("params", std::distance(m_cf.paramsBegin(), m_cf.paramsEnd()));
+      scope.arg("linkQuality", m_minLinkQuality);
+      // the values are mirrored to the ROS parameter server in a single call
+      // (see publishParams), once the firmwareParams have been applied
       for (auto iter = m_cf.paramsBegin(); iter != m_cf.paramsEnd(); ++iter) {
         auto entry = *iter;
-        std::string paramName = "/" + m_tf_prefix + "/" + entry.group + "/" + entry.name;
+        XmlRpc::XmlRpcValue& value = m_paramTable[entry.group][entry.name];
         switch (entry.type) {
           case Crazyflie::ParamTypeUint8:
-            ros::param::set(paramName, m_cf.getParam<uint8_t>(entry.id));
+            value = (int)m_cf.getParam<uint8_t>(entry.id);
             break;
           case Crazyflie::ParamTypeInt8:
-            ros::param::set(paramName, m_cf.getParam<int8_t>(entry.id));
+            value = (int)m_cf.getParam<int8_t>(entry.id);
             break;
           case Crazyflie::ParamTypeUint16:
-            ros::param::set(paramName, m_cf.getParam<uint16_t>(entry.id));
+            value = (int)m_cf.getParam<uint16_t>(entry.id);
             break;
           case Crazyflie::ParamTypeInt16:
-            ros::param::set(paramName, m_cf.getParam<int16_t>(entry.id));
+            value = (int)m_cf.getParam<int16_t>(entry.id);
             break;
           case Crazyflie::ParamTypeUint32:
-            ros::param::set(paramName, (int)m_cf.getParam<uint32_t>(entry.id));
+            value = (int)m_cf.getParam<uint32_t>(entry.id);
             break;
           case Crazyflie::ParamTypeInt32:
-            ros::param::set(paramName, m_cf.getParam<int32_t>(entry.id));
+            value = (int)m_cf.getParam<int32_t>(entry.id);
             break;
           case Crazyflie::ParamTypeFloat:
-            ros::param::set(paramName, m_cf.getParam<float>(entry.id));
+            value = (double)m_cf.getParam<float>(entry.id);
             break;
         }
       }
@@ -485,23 +903,30 @@ public:
       n.setCallbackQueue(&queue);
       m_serviceUpdateParams = n.advertiseService(m_tf_prefix + "/update_params", &CrazyflieROS::updateParams, this);
     }
-    auto end1 = std::chrono::system_clock::now();
-    std::chrono::duration<double> elapsedSeconds1 = end1-start;
-    ROS_INFO("[%s] reqParamTOC: %f s", m_frame.c_str(), elapsedSeconds1.count());
 
     // Logging
     if (m_enableLogging) {
       ROS_INFO("[%s] Requesting logging variables...", m_frame.c_str());
-      m_cf.requestLogToc(m_forceNoCache);
-      auto end2 = std::chrono::system_clock::now();
-      std::chrono::duration<double> elapsedSeconds2 = end2-end1;
-      ROS_INFO("[%s] reqLogTOC: %f s", m_frame.c_str(), elapsedSeconds2.count());
-
+      auto scopeToc = track.scope("logTOC");
+      m_minLinkQuality = 1.0;
+      requestToc("log");
+      scopeToc.arg("variables", std::distance(m_cf.logVariablesBegin(), m_cf.logVariablesEnd()));
+      scopeToc.arg("linkQuality", m_minLinkQuality);
+      scopeToc.end();
+
+      auto scopeBlocks = track.scope("logBlocks");
+      scopeBlocks.arg("blocks", m_logBlocks.size());
       m_logBlocksGeneric.resize(m_logBlocks.size());
       // custom log blocks
       size_t i = 0;
       for (auto& logBlock : m_logBlocks)
       {
+        size_t size = logBlockSize(logBlock.variables);
+        if (size > LogBandwidthPlanner::MaxBlockSize) {
+          ROS_WARN("[%s] Log block %s uses %zu bytes (max: %zu)!",
+            m_frame.c_str(), logBlock.topic_name.c_str(), size, LogBandwidthPlanner::MaxBlockSize);
+        }
+
         std::function<void(uint32_t, std::vector<double>*, void* userData)> cb =
           std::bind(
             &CrazyflieROS::onLogCustom,
@@ -513,56 +938,135 @@ public:
         m_logBlocksGeneric[i].reset(new LogBlockGeneric(
           &m_cf,
           logBlock.variables,
-          (void*)&m_pubLogDataGeneric[i],
+          (void*)&m_logPublishers[i],
           cb));
-        m_logBlocksGeneric[i]->start(logBlock.frequency / 10);
+        if (m_telemetry) {
+          // sized for the requested rate, which a later plan (see setLogPlan) never exceeds
+          const auto& block = logPlan.blocks[i];
+          m_logPublishers[i].telemetry = m_telemetry->addBlock(m_id, logBlock.variables,
+            std::max(block.requestedFrequency, block.frequency));
+        }
+        m_logBlocksGeneric[i]->start(logPlan.blocks[i].period);
         ++i;
       }
-      auto end3 = std::chrono::system_clock::now();
-      std::chrono::duration<double> elapsedSeconds3 = end3-end2;
-      ROS_INFO("[%s] logBlocks: %f s", m_frame.c_str(), elapsedSeconds1.count());
     }
 
     ROS_INFO("Requesting memories...");
-    m_cf.requestMemoryToc();
+    {
+      auto scope = track.scope("memoryTOC");
+      m_cf.requestMemoryToc();
+      scope.arg("memories", std::distance(m_cf.memoriesBegin(), m_cf.memoriesEnd()));
+    }
 
     auto end = std::chrono::system_clock::now();
     std::chrono::duration<double> elapsedSeconds = end-start;
     ROS_INFO("[%s] Ready. Elapsed: %f s", m_frame.c_str(), elapsedSeconds.count());
   }
 
+  // Restarts the log blocks whose period differs between the previous and the new
+  // plan (e.g., after CFs were added to or removed from the radio).
+  void setLogPlan(
+    const LogBandwidthPlanner::Plan& previous,
+    const LogBandwidthPlanner::Plan& logPlan)
+  {
+    for (size_t i = 0; i < m_logBlocksGeneric.size() && i < logPlan.blocks.size(); ++i) {
+      if (m_logBlocksGeneric[i] && (i >= previous.blocks.size() || previous.blocks[i].period != logPlan.blocks[i].period)) {
+        m_logBlocksGeneric[i]->start(logPlan.blocks[i].period);
+      }
+    }
+  }
+
+  // Compares the number of received log packets per block with the plan
+  // and resets the counters.
+  void reportLogRates(double elapsedSeconds, const LogBandwidthPlanner::Plan& logPlan)
+  {
+    std::stringstream sstr;
+    bool lowRate = false;
+    for (size_t i = 0; i < m_logPublishers.size() && i < logPlan.blocks.size(); ++i) {
+      double achieved = m_logPublishers[i].numReceived / elapsedSeconds;
+      const auto& expected = logPlan.blocks[i].frequency;
+      sstr << " " << logPlan.blocks[i].name << ": " << achieved << "/" << expected << " Hz";
+      if (achieved < 0.8 * expected) {
+        lowRate = true;
+      }
+      m_logPublishers[i].numReceived = 0;
+    }
+    if (lowRate) {
+      ROS_WARN("[%s] Log rates (achieved/expected):%s", m_frame.c_str(), sstr.str().c_str());
+    } else {
+      ROS_INFO("[%s] Log rates (achieved/expected):%s", m_frame.c_str(), sstr.str().c_str());
+    }
+  }
+
   void onLinkQuality(float linkQuality) {
+      m_minLinkQuality = std::min(m_minLinkQuality, linkQuality);
+      m_linkQuality = linkQuality;
       if (linkQuality < 0.7) {
         ROS_WARN("[%s] Link Quality low (%f)", m_frame.c_str(), linkQuality);
       }
+      // the CF may have rebooted while the link was down (and lost its memory)
+      bool linkDown = linkQuality <= 0;
+      if (linkDown != m_linkDown) {
+        m_linkDown = linkDown;
+        forgetUploads();
+        if (linkDown) {
+          ROS_WARN("[%s] Link lost, trajectories and NN will be uploaded again", m_frame.c_str());
+        } else {
+          ROS_INFO("[%s] Link restored", m_frame.c_str());
+        }
+      }
   }
 
   void onConsole(const char* msg) {
-    static std::string messageBuffer;
-    messageBuffer += msg;
-    size_t pos = messageBuffer.find('\n');
+    m_consoleBuffer += msg;
+    size_t pos = m_consoleBuffer.find('\n');
     if (pos != std::string::npos) {
-      messageBuffer[pos] = 0;
-      ROS_INFO("[%s] CF Console: %s", m_frame.c_str(), messageBuffer.c_str());
-      messageBuffer.erase(0, pos+1);
+      m_consoleBuffer[pos] = 0;
+      ROS_INFO("[%s] CF Console: %s", m_frame.c_str(), m_consoleBuffer.c_str());
+      m_consoleBuffer.erase(0, pos+1);
     }
   }
 
+  // content fingerprints of the TOCs (equal fingerprints == identical TOCs)
+  uint64_t paramTocFingerprint() const {
+    return m_paramTocFingerprint;
+  }
+
+  uint64_t logTocFingerprint() const {
+    return m_logTocFingerprint;
+  }
+
   void onLogCustom(uint32_t time_in_ms, std::vector<double>* values, void* userData) {
 
-    ros::Publisher* pub = reinterpret_cast<ros::Publisher*>(userData);
+    LogBlockPublisher* block = reinterpret_cast<LogBlockPublisher*>(userData);
+    ++block->numReceived;
 
-    crazyflie_driver::GenericLogData msg;
+    // Reuse the message of this block, unless a subscriber within this process
+    // still holds on to the last one we published.
+    if (!block->msg.unique()) {
+      block->msg.reset(new crazyflie_driver::GenericLogData);
+      block->msg->values.reserve(values->size());
+    }
+    crazyflie_driver::GenericLogData& msg = *block->msg;
     msg.header.stamp = ros::Time(time_in_ms/1000.0);
-    msg.values = *values;
+    msg.values.assign(values->begin(), values->end());
 
     m_logFile << time_in_ms / 1000.0 << ",";
     for (const auto& value : *values) {
       m_logFile << value << ",";
     }
-    m_logFile << std::endl;
+    // no std::endl here: flushing on every packet is expensive
+    m_logFile << "\n";
+
+    if (block->telemetry) {
+      block->telemetry->append(ros::WallTime::now().toSec(), *values);
+    }
 
-    pub->publish(msg);
+    if (m_publishSharedLogData) {
+      block->pub.publish(block->msg);
+    } else {
+      block->pub.publish(msg);
+    }
   }
 
   const Crazyflie::ParamTocEntry* getParamTocEntry(
@@ -599,6 +1103,106 @@ public:
     m_initializedPosition = true;
   }
 
+private:
+  // per log block publisher; the message is kept around to avoid allocations
+  struct LogBlockPublisher
+  {
+    ros::Publisher pub;
+    crazyflie_driver::GenericLogDataPtr msg;
+    uint32_t numReceived;
+    TelemetryStore::Block* telemetry;
+  };
+
+  // Requests the param or log TOC. The first request of each kind in the swarm
+  // runs alone, so that all other CFs find the TOC in crazyflie_cpp's cache
+  // (unless force_no_cache is set).
+  void requestToc(const std::string& kind)
+  {
+    bool first = m_tocCache ? m_tocCache->beginFetch(kind, m_forceNoCache) : false;
+    try {
+      if (kind == "param") {
+        m_cf.requestParamToc(m_forceNoCache);
+      } else {
+        m_cf.requestLogToc(m_forceNoCache);
+      }
+    } catch (...) {
+      if (m_tocCache) {
+        m_tocCache->abortFetch(kind, first);
+      }
+      throw;
+    }
+
+    uint64_t fingerprint = TocCache::hash(kind);
+    if (kind == "param") {
+      for (auto iter = m_cf.paramsBegin(); iter != m_cf.paramsEnd(); ++iter) {
+        fingerprint = TocCache::hash(iter->group + "." + iter->name + ":" + std::to_string(iter->id)
+          + ":" + std::to_string(iter->type) + ":" + std::to_string(iter->readonly), fingerprint);
+      }
+      m_paramTocFingerprint = fingerprint;
+    } else {
+      for (auto iter = m_cf.logVariablesBegin(); iter != m_cf.logVariablesEnd(); ++iter) {
+        fingerprint = TocCache::hash(iter->group + "." + iter->name + ":" + std::to_string(iter->id)
+          + ":" + std::to_string(iter->type), fingerprint);
+      }
+      m_logTocFingerprint = fingerprint;
+    }
+
+    if (m_tocCache) {
+      bool hit = m_tocCache->endFetch(kind, first, fingerprint, m_forceNoCache);
+      ROS_INFO("[%s] %s TOC %016llx: cache %s", m_frame.c_str(), kind.c_str(),
+        (unsigned long long)fingerprint, hit ? "hit" : "miss");
+    }
+  }
+
+  // size of a log block in bytes, based on the log TOC
+  size_t logBlockSize(const std::vector<std::string>& variables) const
+  {
+    size_t size = 0;
+    for (const auto& variable : variables) {
+      size_t pos = variable.find(".");
+      std::string group(variable.begin(), variable.begin() + std::min(pos, variable.size()));
+      std::string name(pos == std::string::npos ? variable.end() : variable.begin() + pos + 1, variable.end());
+      for (auto iter = m_cf.logVariablesBegin(); iter != m_cf.logVariablesEnd(); ++iter) {
+        if (iter->group == group && iter->name == name) {
+          size += logTypeSize(iter->type);
+          break;
+        }
+      }
+    }
+    return size;
+  }
+
+  // stores the value as the firmware sees it (after conversion to the TOC type)
+  void mirrorParam(
+    const Crazyflie::ParamTocEntry& entry,
+    double value)
+  {
+    XmlRpc::XmlRpcValue& mirrored = m_paramTable[entry.group][entry.name];
+    switch (entry.type) {
+      case Crazyflie::ParamTypeUint8:
+        mirrored = (int)(uint8_t)value;
+        break;
+      case Crazyflie::ParamTypeInt8:
+        mirrored = (int)(int8_t)value;
+        break;
+      case Crazyflie::ParamTypeUint16:
+        mirrored = (int)(uint16_t)value;
+        break;
+      case Crazyflie::ParamTypeInt16:
+        mirrored = (int)(int16_t)value;
+        break;
+      case Crazyflie::ParamTypeUint32:
+        mirrored = (int)(uint32_t)value;
+        break;
+      case Crazyflie::ParamTypeInt32:
+        mirrored = (int)(int32_t)value;
+        break;
+      case Crazyflie::ParamTypeFloat:
+        mirrored = (double)(float)value;
+        break;
+    }
+  }
+
 private:
   std::string m_tf_prefix;
   Crazyflie m_cf;
@@ -618,14 +1222,68 @@ private:
   ros::ServiceServer m_serviceUploadNN;
 
   std::vector<crazyflie_driver::LogBlock> m_logBlocks;
-  std::vector<ros::Publisher> m_pubLogDataGeneric;
+  std::vector<LogBlockPublisher> m_logPublishers;
   std::vector<std::unique_ptr<LogBlockGeneric> > m_logBlocksGeneric;
 
   ros::Subscriber m_subscribeJoy;
 
   std::ofstream m_logFile;
   bool m_forceNoCache;
+  bool m_publishSharedLogData;
+  TelemetryStore* m_telemetry;
+  TocCache* m_tocCache;
+  const FeasibilityChecker* m_feasibility;
+  uint64_t m_paramTocFingerprint;
+  uint64_t m_logTocFingerprint;
   bool m_initializedPosition;
+  // one buffer per CF; CFs of a group are brought up concurrently
+  std::string m_consoleBuffer;
+  // lowest link quality since the start of the current bring-up phase
+  float m_minLinkQuality;
+  std::atomic<float> m_linkQuality;
+  uint8_t m_groupMask;
+  // trajectories uploaded by this server (forgotten if the link drops, see onLinkQuality)
+  struct UploadedTrajectory
+  {
+    uint32_t pieceOffset;
+    size_t numPieces;
+    uint64_t hash;
+    float duration;       // s, at timescale 1
+    float minTimescale;   // see minTimescale()
+  };
+  std::map<uint8_t, UploadedTrajectory> m_trajectories;
+  // last high-level command (see isExecuting); set by the server and the slow thread
+  struct Execution
+  {
+    int trajectoryId;
+    float timescale;
+    std::chrono::high_resolution_clock::time_point start;
+  };
+  // m_trajectories and m_execution (read by the server thread)
+  mutable std::mutex m_trajectoryMutex;
+  Execution m_execution;
+  // see numCommands; only used on the slow thread
+  uint32_t m_numCommands;
+  // content hash of the NN uploaded by this server (0: unknown)
+  std::atomic<uint64_t> m_nnHash;
+  // no ACKs (see onLinkQuality)
+  bool m_linkDown;
+
+  static uint64_t trajectoryHash(uint32_t pieceOffset, const std::vector<Crazyflie::poly4d>& pieces)
+  {
+    return TocCache::hash(std::string(reinterpret_cast<const char*>(pieces.data()), pieces.size() * sizeof(Crazyflie::poly4d)), pieceOffset);
+  }
+
+  static float trajectoryDuration(const std::vector<Crazyflie::poly4d>& pieces)
+  {
+    float duration = 0;
+    for (const auto& piece : pieces) {
+      duration += piece.duration;
+    }
+    return duration;
+  }
+  // firmware parameter values ({group: {name: value}}), see publishParams
+  XmlRpc::XmlRpcValue m_paramTable;
 };
 
 
@@ -640,6 +1298,7 @@ public:
   };
 
   CrazyflieGroup(
+    const SwarmConfig& swarmConfig,
     const std::vector<libobjecttracker::DynamicsConfiguration>& dynamicsConfigurations,
     const std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations,
     pcl::PointCloud<pcl::PointXYZ>::Ptr pMarkers,
@@ -651,7 +1310,13 @@ public:
     const std::vector<crazyflie_driver::LogBlock>& logBlocks,
     std::string interactiveObject,
     bool writeCSVs,
-    bool sendPositionOnly
+    bool sendPositionOnly,
+    const BroadcastScheduler::Settings& broadcastSettings,
+    const std::string& ackVariable,
+    TelemetryStore* telemetry,
+    TocCache* tocCache,
+    const FeasibilityChecker* feasibility,
+    StartupTracer* tracer
     )
     : m_cfs()
     , m_tracker(nullptr)
@@ -660,6 +1325,7 @@ public:
     , m_pMocapObjects(pMocapObjects)
     , m_slowQueue()
     , m_cfbc("radio://" + std::to_string(radio) + "/" + std::to_string(channel) + "/2M/" + broadcastAddress)
+    , m_cfbcMutex()
     , m_isEmergency(false)
     , m_useMotionCaptureObjectTracking(useMotionCaptureObjectTracking)
     , m_br()
@@ -668,12 +1334,37 @@ public:
     , m_outputCSVs()
     , m_phase(0)
     , m_phaseStart()
+    , m_logPlan()
+    , m_telemetry(telemetry)
+    , m_tocCache(tocCache)
+    , m_feasibility(feasibility)
+    , m_tracer(tracer)
+    , m_swarmConfig(swarmConfig)
+    , m_channel(channel)
+    , m_dynamicsConfigurations(dynamicsConfigurations)
+    , m_markerConfigurations(markerConfigurations)
+    , m_objectConfigs()
+    , m_bringup()
+    , m_mutex()
+    , m_slowThreadMutex()
+    , m_slowThreadRunning(true)
+    , m_commands(broadcastSettings, [radio](const BroadcastScheduler::Stats& stats) {
+        ROS_INFO("[radio %d] %s", radio, BroadcastScheduler::format(stats).c_str());
+      })
+    , m_ackVariable(ackVariable)
+    , m_ackThresholds()
+    , m_pingTick(0)
+    , m_lastLogRateReport()
+    , m_logRateReportPeriod(0)
+    , m_streams()
+    , m_streamTimer()
+    , m_commandGeneration(0)
   {
     std::vector<libobjecttracker::Object> objects;
-    readObjects(objects, channel, logBlocks);
+    readObjects(swarmConfig, objects, channel, logBlocks);
     m_tracker = new libobjecttracker::ObjectTracker(
-      dynamicsConfigurations,
-      markerConfigurations,
+      m_dynamicsConfigurations,
+      m_markerConfigurations,
       objects);
     m_tracker->setLogWarningCallback(logWarn);
     if (writeCSVs) {
@@ -697,6 +1388,27 @@ public:
     return m_radio;
   }
 
+  int channel() const {
+    return m_channel;
+  }
+
+  bool hasCrazyflie(int id)
+  {
+    return !typeOf(id).empty();
+  }
+
+  // empty if the CF is not part of this group
+  std::string typeOf(int id)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto cf : m_cfs) {
+      if (cf->id() == id) {
+        return cf->type();
+      }
+    }
+    return std::string();
+  }
+
   void runInteractiveObject(std::vector<CrazyflieBroadcaster::externalPose> &states)
   {
     publishRigidBody(m_interactiveObject, 0xFF, states);
@@ -704,6 +1416,8 @@ public:
 
   void runFast()
   {
+    // only contended while CFs are added or removed
+    std::lock_guard<std::mutex> lock(m_mutex);
     auto stamp = std::chrono::high_resolution_clock::now();
 
     std::vector<CrazyflieBroadcaster::externalPose> states;
@@ -772,8 +1486,14 @@ public:
       }
     }
 
+    // the emergency stop must not wait behind the pose packets
+    if (m_isEmergency) {
+      return;
+    }
+
     {
       auto start = std::chrono::high_resolution_clock::now();
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
       if (!m_sendPositionOnly) {
         m_cfbc.sendExternalPoses(states);
       } else {
@@ -793,6 +1513,9 @@ public:
       // ROS_INFO("Broadcasting: %f s", elapsedSeconds.count());
     }
 
+    // repeats of pending broadcast commands, between the pose packets
+    m_commands.run(broadcastLinkQuality());
+
     // auto time = std::chrono::duration_cast<std::chrono::microseconds>(
     //   std::chrono::high_resolution_clock::now().time_since_epoch()).count();
     // for (const auto& state : states) {
@@ -801,66 +1524,584 @@ public:
 
   }
 
+  // Waits for service calls and tasks; with enable_logging, a timer adds
+  // the pings to the same queue.
   void runSlow()
   {
     ros::NodeHandle nl("~");
     bool enableLogging;
     nl.getParam("enable_logging", enableLogging);
+    nl.param<double>("log_rate_report_period", m_logRateReportPeriod, 10.0);
 
-    while(ros::ok() && !m_isEmergency) {
-      if (enableLogging) {
-        for (const auto& cf : m_cfs) {
-          cf->sendPing();
-        }
-      }
-      m_slowQueue.callAvailable(ros::WallDuration(0));
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ros::NodeHandle n;
+    n.setCallbackQueue(&m_slowQueue);
+    ros::WallTimer pingTimer;
+    if (enableLogging) {
+      m_lastLogRateReport = std::chrono::high_resolution_clock::now();
+      pingTimer = n.createWallTimer(ros::WallDuration(1.0 / LogBandwidthPlanner::TickRate), &CrazyflieGroup::onPingTimer, this);
     }
-  }
 
-  void emergency()
-  {
-    m_isEmergency = true;
-  }
+    while (ros::ok() && !m_isEmergency) {
+      // the timeout only bounds the time to notice a shutdown
+      m_slowQueue.callAvailable(ros::WallDuration(0.1));
+    }
+    pingTimer.stop();
 
-  void takeoff(float height, float duration, uint8_t groupMask)
-  {
-    // for (size_t i = 0; i < 10; ++i) {
-    m_cfbc.takeoff(height, duration, groupMask);
-      // std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    // }
+    std::lock_guard<std::mutex> lock(m_slowThreadMutex);
+    m_slowThreadRunning = false;
+    m_slowQueue.clear();
   }
 
-  void land(float height, float duration, uint8_t groupMask)
+  // Runs f on the slow thread (which owns the radio connections of the CFs)
+  // and waits for the result. Returns false if the slow thread has stopped.
+  bool runOnSlowThread(
+    std::function<bool()> f)
   {
-    // for (size_t i = 0; i < 10; ++i) {
-      m_cfbc.land(height, duration, groupMask);
-      // std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    // }
+    std::packaged_task<bool()> task(f);
+    std::future<bool> result = task.get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_slowThreadMutex);
+      if (!m_slowThreadRunning) {
+        return false;
+      }
+      m_slowQueue.addCallback(boost::make_shared<SlowTask>(std::move(task)));
+    }
+    result.wait();
+    try {
+      return result.get();
+    } catch (std::future_error&) {
+      // dropped, because the slow thread stopped
+      return false;
+    }
+  }
+
+  // Adds and/or removes a CF (removeId < 0: add only; add == nullptr: remove only).
+  // Must run on the slow thread. The new CF is brought up while the fast loop keeps
+  // running; the fast loop only waits for the final swap of the CF list and the
+  // object tracker. The tracker continues from the current poses of the other CFs.
+  // The log bandwidth is planned again for the new number of CFs.
+  bool changeCrazyflies(
+    int removeId,
+    const SwarmConfig::CrazyflieConfig* add,
+    std::string& message)
+  {
+    size_t removeIdx = m_cfs.size();
+    for (size_t i = 0; i < m_cfs.size(); ++i) {
+      if (m_cfs[i]->id() == removeId) {
+        removeIdx = i;
+      }
+    }
+    if (removeId >= 0 && removeIdx == m_cfs.size()) {
+      message = "cf" + std::to_string(removeId) + " is not part of radio " + std::to_string(m_radio);
+      return false;
+    }
+
+    // the radio bandwidth is shared by the CFs that remain
+    size_t numCFs = m_cfs.size() - (removeIdx < m_cfs.size() ? 1 : 0) + (add ? 1 : 0);
+    LogBandwidthPlanner::Plan logPlan = planLogs(numCFs);
+
+    CrazyflieROS* added = nullptr;
+    Eigen::Affine3f addedTransformation;
+    std::pair<int, int> addedObjectConfig;
+    if (add) {
+      std::string type = add->type;
+      if (type.empty() && removeIdx < m_cfs.size()) {
+        type = m_cfs[removeIdx]->type();
+      }
+      if (m_swarmConfig.types.find(type) == m_swarmConfig.types.end()) {
+        message = "Unknown crazyflie type " + type;
+        return false;
+      }
+      const SwarmConfig::TypeConfig& typeConfig = m_swarmConfig.type(type);
+      addedObjectConfig = std::make_pair(typeConfig.markerConfiguration, typeConfig.dynamicsConfiguration);
+      addedTransformation = Eigen::Translation3f(add->initialPosition[0], add->initialPosition[1], add->initialPosition[2]);
+      addFirmwareParams(type);
+
+      CFConfig config = cfConfig(add->id, type);
+      try {
+        {
+          auto scope = m_tracer->track(m_radio, config.frame).scope("syson");
+          Crazyflie cf(config.uri);
+          cf.syson();
+          for (size_t i = 0; i < 50; ++i) {
+            cf.sendPing();
+          }
+        }
+        added = bringup(config, logPlan);
+      } catch (std::exception& e) {
+        delete added;
+        message = "Could not bring up " + config.frame + ": " + e.what();
+        return false;
+      }
+    }
+
+    // new object tracker
+    std::vector<CrazyflieROS*> cfs;
+    std::vector<std::pair<int, int> > objectConfigs;
+    std::vector<libobjecttracker::Object> objects;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (size_t i = 0; i < m_cfs.size(); ++i) {
+        if (i != removeIdx) {
+          cfs.push_back(m_cfs[i]);
+          objectConfigs.push_back(m_objectConfigs[i]);
+          objects.push_back(libobjecttracker::Object(
+            m_objectConfigs[i].first,
+            m_objectConfigs[i].second,
+            m_tracker->objects()[i].transformation()));
+        }
+      }
+    }
+    if (added) {
+      cfs.push_back(added);
+      objectConfigs.push_back(addedObjectConfig);
+      objects.push_back(libobjecttracker::Object(addedObjectConfig.first, addedObjectConfig.second, addedTransformation));
+    }
+    libobjecttracker::ObjectTracker* tracker = new libobjecttracker::ObjectTracker(
+      m_dynamicsConfigurations,
+      m_markerConfigurations,
+      objects);
+    tracker->setLogWarningCallback(logWarn);
+
+    CrazyflieROS* removed = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (removeIdx < m_cfs.size()) {
+        removed = m_cfs[removeIdx];
+        if (!m_outputCSVs.empty()) {
+          m_outputCSVs.erase(m_outputCSVs.begin() + removeIdx);
+        }
+      }
+      if (added && !m_outputCSVs.empty()) {
+        m_outputCSVs.push_back(std::unique_ptr<std::ofstream>(new std::ofstream));
+      }
+      m_cfs.swap(cfs);
+      m_objectConfigs.swap(objectConfigs);
+      std::swap(m_tracker, tracker);
+    }
+    delete tracker;
+    if (removed) {
+      // a CF added with the same id does not have the streamed segments
+      m_streams.erase(removed->id());
+    }
+    delete removed;
+
+    // the other CFs log at the rates of the new plan
+    if (m_bringup.enableLogging) {
+      for (auto cf : m_cfs) {
+        if (cf == added) {
+          continue;
+        }
+        try {
+          cf->setLogPlan(m_logPlan, logPlan);
+        } catch (std::exception& e) {
+          ROS_WARN("[%s] Could not change log rates: %s", cf->frame().c_str(), e.what());
+        }
+      }
+      ROS_INFO("[radio %d] %s", m_radio, LogBandwidthPlanner::summary(logPlan).c_str());
+    }
+    m_logPlan = logPlan;
+
+    message = "radio " + std::to_string(m_radio) + ": " + std::to_string(m_cfs.size()) + " CFs";
+    return true;
+  }
+
+  // Called from the emergency thread: stops all CFs of this radio right away,
+  // without waiting for pose packets or uploads (at most one of their packets).
+  // The broadcast scheduler is closed first: pending commands are dropped and
+  // later ones refused, so that none of them is sent after the stop. The repeats
+  // are spread out to survive burst losses.
+  // Returns the time from the trigger to the first stop packet.
+  double emergency(
+    std::chrono::high_resolution_clock::time_point trigger,
+    int numRepeats,
+    std::chrono::milliseconds delayBetweenRepeats)
+  {
+    m_isEmergency = true;
+    m_commands.close();
+    {
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
+      m_cfbc.stop(0);
+    }
+    std::chrono::duration<double> latency = std::chrono::high_resolution_clock::now() - trigger;
+    for (int i = 1; i < numRepeats; ++i) {
+      std::this_thread::sleep_for(delayBetweenRepeats);
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
+      m_cfbc.stop(0);
+    }
+    return latency.count();
+  }
+
+  // Ids of the selected CFs of this group (ids, or all CFs of the group mask if ids
+  // is empty), e.g., to report them as failed if the slow thread stopped
+  std::vector<int> selectedIds(
+    const std::set<int>& ids,
+    uint8_t groupMask)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<int> result;
+    for (auto cf : m_cfs) {
+      bool selected = ids.empty()
+        ? (groupMask == 0 || (cf->groupMask() & groupMask))
+        : ids.count(cf->id()) > 0;
+      if (selected) {
+        result.push_back(cf->id());
+      }
+    }
+    return result;
+  }
+
+  // Uploads a trajectory to the selected CFs of this group (ids, or all CFs of the
+  // group mask if ids is empty), one after the other, skipping CFs that have it
+  // unless forced. Must run on the slow thread.
+  void uploadTrajectory(
+    const std::set<int>& ids,
+    uint8_t groupMask,
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    bool force,
+    crazyswarm::UploadSwarmTrajectory::Response& res)
+  {
+    for (auto cf : m_cfs) {
+      bool selected = ids.empty()
+        ? (groupMask == 0 || (cf->groupMask() & groupMask))
+        : ids.count(cf->id()) > 0;
+      if (!selected) {
+        continue;
+      }
+      try {
+        auto start = std::chrono::high_resolution_clock::now();
+        if (cf->uploadTrajectory(trajectoryId, pieceOffset, pieces, !force)) {
+          std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+          res.uploadedIds.push_back(cf->id());
+          res.throughput.push_back(pieces.size() * sizeof(Crazyflie::poly4d) / elapsed.count());
+        } else {
+          res.skippedIds.push_back(cf->id());
+        }
+      } catch (std::exception& e) {
+        ROS_ERROR("[%s] Could not upload trajectory: %s", cf->frame().c_str(), e.what());
+        res.failedIds.push_back(cf->id());
+      }
+    }
+  }
+
+  // Uploads a trajectory to all CFs of this group at once (see TrajectoryBroadcaster).
+  // The broadcast writes the memory of every CF on this radio, selected or not, so it
+  // is refused while an unselected CF flies the same trajectory id or memory range.
+  // Each packet is repeated until the CF with the worst link quality received it with
+  // the given confidence (at most maxRepeats times). Afterwards, each CF is verified
+  // with the checksum it logs (checksumVariable, see verifyTrajectory); CFs that do
+  // not confirm the trajectory get a unicast upload. Falls back to
+  // uploadTrajectory() if the broadcast is refused or the CFs use different trajectory
+  // memories. Must run on the slow thread.
+  void broadcastTrajectory(
+    const std::set<int>& ids,
+    uint8_t groupMask,
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    size_t maxRepeats,
+    std::chrono::microseconds delayBetweenPackets,
+    double confidence,
+    const std::string& checksumVariable,
+    bool force,
+    crazyswarm::UploadSwarmTrajectory::Response& res)
+  {
+    std::vector<CrazyflieROS*> selected;
+    CrazyflieROS* busy = nullptr;
+    int memoryId = -1;
+    bool sameMemory = true;
+    for (auto cf : m_cfs) {
+      if (ids.empty()
+        ? (groupMask == 0 || (cf->groupMask() & groupMask))
+        : ids.count(cf->id()) > 0) {
+        selected.push_back(cf);
+      } else if (cf->isExecuting(trajectoryId, pieceOffset, pieces.size())) {
+        busy = cf;
+      }
+      int id = cf->trajectoryMemoryId();
+      sameMemory &= (id >= 0 && (memoryId < 0 || id == memoryId));
+      memoryId = id;
+    }
+    if (selected.empty()) {
+      return;
+    }
+    if (!sameMemory) {
+      ROS_WARN("[radio %d] CFs use different trajectory memories, uploading one after the other", m_radio);
+      uploadTrajectory(ids, groupMask, trajectoryId, pieceOffset, pieces, force, res);
+      return;
+    }
+    if (busy) {
+      ROS_WARN("[radio %d] %s flies trajectory %d or uses its memory, uploading one after the other",
+        m_radio, busy->frame().c_str(), trajectoryId);
+      uploadTrajectory(ids, groupMask, trajectoryId, pieceOffset, pieces, force, res);
+      return;
+    }
+
+    std::vector<CrazyflieROS*> missing;
+    for (auto cf : selected) {
+      if (!force && cf->hasTrajectory(trajectoryId, pieceOffset, pieces)) {
+        res.skippedIds.push_back(cf->id());
+      } else {
+        missing.push_back(cf);
+      }
+    }
+    if (missing.empty()) {
+      return;
+    }
+
+    // as broadcastLinkQuality(), but only for the CFs that need the trajectory
+    double worstLinkQuality = 0.9;
+    for (auto cf : missing) {
+      worstLinkQuality = std::min<double>(worstLinkQuality, cf->linkQuality());
+    }
+    size_t numRepeats = TrajectoryBroadcaster::numRepeats(pieces.size(), std::max(worstLinkQuality, 0.1),
+      confidence, maxRepeats);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    double uploaded = ros::WallTime::now().toSec();
+    m_cfbc.uploadTrajectory(memoryId, trajectoryId, pieceOffset, pieces, numRepeats, delayBetweenPackets, m_cfbcMutex);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    // every CF on this radio received (some of) the packets; the selected ones that
+    // had the trajectory got the same bytes again
+    for (auto cf : m_cfs) {
+      if (std::find(selected.begin(), selected.end(), cf) == selected.end()) {
+        cf->forgetTrajectories(trajectoryId, pieceOffset, pieces.size());
+      }
+    }
+    std::vector<CrazyflieROS*> resend = verifyTrajectory(missing, pieces, checksumVariable, uploaded);
+
+    size_t numResent = 0;
+    for (auto cf : missing) {
+      if (std::find(resend.begin(), resend.end(), cf) == resend.end()) {
+        cf->recordTrajectory(trajectoryId, pieceOffset, pieces);
+        res.uploadedIds.push_back(cf->id());
+        res.throughput.push_back(pieces.size() * sizeof(Crazyflie::poly4d) / elapsed.count());
+        continue;
+      }
+      cf->forgetTrajectories(trajectoryId, pieceOffset, pieces.size());
+      try {
+        auto start = std::chrono::high_resolution_clock::now();
+        cf->uploadTrajectory(trajectoryId, pieceOffset, pieces, false);
+        std::chrono::duration<double> unicast = std::chrono::high_resolution_clock::now() - start;
+        res.uploadedIds.push_back(cf->id());
+        res.throughput.push_back(pieces.size() * sizeof(Crazyflie::poly4d) / (elapsed + unicast).count());
+        ++numResent;
+      } catch (std::exception& e) {
+        ROS_ERROR("[%s] Could not upload trajectory: %s", cf->frame().c_str(), e.what());
+        res.failedIds.push_back(cf->id());
+      }
+    }
+    ROS_INFO("[radio %d] Broadcast trajectory %d (%zu packets x %zu, link quality %.2f) in %f s, re-sent to %zu/%zu CFs",
+      m_radio, trajectoryId, TrajectoryBroadcaster::numPackets(pieces.size()), numRepeats, worstLinkQuality,
+      elapsed.count(), numResent, missing.size());
+  }
+
+  // Returns the CFs that did not confirm a broadcast trajectory: the firmware logs
+  // the checksum of the last defined trajectory (see TrajectoryBroadcaster), which
+  // has to match the pieces in a sample received after the upload started. The
+  // pings carry the log data, as the ping timer does not run meanwhile. CFs that do
+  // not log the variable are not verified. Must run on the slow thread.
+  std::vector<CrazyflieROS*> verifyTrajectory(
+    const std::vector<CrazyflieROS*>& cfs,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    const std::string& checksumVariable,
+    double since)
+  {
+    const double Timeout = 0.5;   // s, some log periods
+    std::vector<CrazyflieROS*> pending(cfs);
+    if (!m_telemetry || checksumVariable.empty()) {
+      return pending;
+    }
+    uint16_t checksum = TrajectoryBroadcaster::checksum(pieces);
+    double deadline = ros::WallTime::now().toSec() + Timeout;
+    std::vector<CrazyflieROS*> failed;
+    while (!pending.empty()) {
+      bool timeout = ros::WallTime::now().toSec() >= deadline;
+      for (auto iter = pending.begin(); iter != pending.end();) {
+        CrazyflieROS* cf = *iter;
+        cf->sendPing();
+        double time;
+        double value;
+        bool logged = m_telemetry->latest(cf->id(), checksumVariable, time, value);
+        if (logged && time > since && value == checksum) {
+          iter = pending.erase(iter);
+        } else if (!logged || timeout) {
+          failed.push_back(cf);
+          iter = pending.erase(iter);
+        } else {
+          ++iter;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return failed;
+  }
+
+  // Uploads a NN to the selected CFs of this group (ids, or all CFs of the group
+  // mask if ids is empty), one after the other, skipping CFs that already have
+  // it unless forced. Must run on the slow thread.
+  void uploadNN(
+    const std::set<int>& ids,
+    uint8_t groupMask,
+    const std::vector<uint8_t>& nnDesc,
+    uint64_t hash,
+    bool force,
+    crazyswarm::UploadSwarmNN::Response& res)
+  {
+    std::vector<CrazyflieROS*> selected;
+    for (auto cf : m_cfs) {
+      if (ids.empty()
+        ? (groupMask == 0 || (cf->groupMask() & groupMask))
+        : ids.count(cf->id()) > 0) {
+        if (!force && cf->hasNN(hash)) {
+          res.skippedIds.push_back(cf->id());
+        } else {
+          selected.push_back(cf);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < selected.size(); ++i) {
+      CrazyflieROS* cf = selected[i];
+      try {
+        double elapsed = cf->uploadNN(nnDesc, hash);
+        res.uploadedIds.push_back(cf->id());
+        res.throughput.push_back(nnDesc.size() / elapsed);
+        ROS_INFO("[radio %d] NN %zu/%zu: %s, %zu B in %.3f s (%.0f B/s)", m_radio, i + 1, selected.size(),
+          cf->frame().c_str(), nnDesc.size(), elapsed, nnDesc.size() / elapsed);
+      } catch (std::exception& e) {
+        ROS_ERROR("[%s] Could not upload NN: %s", cf->frame().c_str(), e.what());
+        res.failedIds.push_back(cf->id());
+      }
+    }
+  }
+
+  // Streams a long trajectory to one CF (see TrajectoryStream): uploads the first
+  // segment, starts it, and uploads/starts the others from a timer on the slow
+  // thread. Replaces a running stream of the same CF; empty pieces only stop it.
+  // Must run on the slow thread.
+  bool streamTrajectory(
+    int id,
+    const TrajectoryStream::Settings& settings,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    std::string& message)
+  {
+    CrazyflieROS* cf = crazyflie(id);
+    if (!cf) {
+      message = "Unknown CF " + std::to_string(id);
+      return false;
+    }
+    m_streams.erase(id);
+    if (pieces.empty()) {
+      message = "Stopped streaming";
+      return true;
+    }
+    if (!TrajectoryStream::check(settings, pieces, message)) {
+      return false;
+    }
+    if (m_feasibility) {
+      FeasibilityResult result = m_feasibility->check(pieces, settings.timescale, cf->type());
+      if (!result.feasible()) {
+        message = "Not feasible: " + result.describe();
+        return false;
+      }
+    }
+
+    std::unique_ptr<TrajectoryStream> stream(new TrajectoryStream(settings, pieces));
+    double latency;
+    auto sent = TrajectoryStream::clock::now();
+    try {
+      cf->uploadTrajectory(stream->trajectoryId(0), stream->pieceOffset(0), stream->pieces(0), false);
+      stream->uploaded(0);
+      sent = TrajectoryStream::clock::now();
+      cf->startTrajectory(stream->trajectoryId(0), settings.timescale);
+      // half of the acknowledged round trip
+      latency = std::chrono::duration<double>(TrajectoryStream::clock::now() - sent).count() / 2;
+    } catch (std::exception& e) {
+      message = e.what();
+      return false;
+    }
+    stream->begin(sent + std::chrono::duration_cast<TrajectoryStream::clock::duration>(
+      std::chrono::duration<double>(latency)), latency);
+    message = "Streaming " + std::to_string(pieces.size()) + " pieces in "
+      + std::to_string(stream->numSegments()) + " segments";
+    m_streams[id] = StreamState{std::move(stream), m_commandGeneration, cf->numCommands()};
+
+    if (!m_streamTimer.isValid()) {
+      ros::NodeHandle n;
+      n.setCallbackQueue(&m_slowQueue);
+      m_streamTimer = n.createWallTimer(ros::WallDuration(StreamTimerPeriod), &CrazyflieGroup::onStreamTimer, this);
+    }
+    m_streamTimer.start();
+    return true;
   }
 
-  void stop(uint8_t groupMask)
+  // The broadcast commands return right away; the first copy is sent at startTime
+  // and the repeats by the fast loop (see BroadcastScheduler)
+  typedef std::future<BroadcastScheduler::clock::time_point> CommandSent;
+
+  CommandSent takeoff(float height, float duration, uint8_t groupMask, BroadcastScheduler::clock::time_point startTime)
+  {
+    setExecution(groupMask, -1, 1.0f);
+    return scheduleCommand("takeoff", groupMask, [=] {
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
+      m_cfbc.takeoff(height, duration, groupMask);
+    }, startTime);
+  }
+
+  CommandSent land(float height, float duration, uint8_t groupMask, BroadcastScheduler::clock::time_point startTime)
+  {
+    setExecution(groupMask, -1, 1.0f);
+    return scheduleCommand("land", groupMask, [=] {
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
+      m_cfbc.land(height, duration, groupMask);
+    }, startTime);
+  }
+
+  CommandSent stop(uint8_t groupMask, BroadcastScheduler::clock::time_point startTime)
   {
-    // for (size_t i = 0; i < 10; ++i) {
+    setExecution(groupMask, -1, 1.0f);
+    return scheduleCommand("stop", groupMask, [=] {
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
       m_cfbc.stop(groupMask);
-      // std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    // }
+    }, startTime);
   }
 
-  void startTrajectory(
+  CommandSent startTrajectory(
     uint8_t trajectoryId,
     float timescale,
     bool reversed,
-    uint8_t groupMask)
+    uint8_t groupMask,
+    BroadcastScheduler::clock::time_point startTime)
   {
-    // for (size_t i = 0; i < 10; ++i) {
+    setExecution(groupMask, trajectoryId, timescale);
+    return scheduleCommand("startTrajectory", groupMask, [=] {
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
       m_cfbc.startTrajectory(trajectoryId, timescale, reversed, groupMask);
-      // std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    // }
+    }, startTime);
+  }
+
+  // Largest fastest feasible timescale of the trajectory over the CFs of the group mask
+  double minTimescale(
+    uint8_t trajectoryId,
+    uint8_t groupMask)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    double result = 0;
+    for (auto cf : m_cfs) {
+      if (groupMask == 0 || (cf->groupMask() & groupMask)) {
+        result = std::max(result, cf->minTimescale(trajectoryId));
+      }
+    }
+    return result;
   }
 
   void nextPhase()
   {
+      std::lock_guard<std::mutex> lock(m_mutex);
       for (size_t i = 0; i < m_outputCSVs.size(); ++i) {
         auto& file = *m_outputCSVs[i];
         file.close();
@@ -870,61 +2111,95 @@ public:
       m_phase += 1;
       m_phaseStart = std::chrono::system_clock::now();
   }
-#if 0
-  template<class T, class U>
-  void updateParam(uint8_t group, uint8_t id, Crazyflie::ParamType type, const std::string& ros_param) {
-      U value;
-      ros::param::get(ros_param, value);
-      m_cfbc.setParam<T>(group, id, type, (T)value);
+  // Sets the given parameter values ({group: {name: value}}) on all CFs of this group
+  // and mirrors them (see CrazyflieROS::mirrorParams). Groups with an identical param
+  // TOC get a broadcast, which returns right away; the fast loop repeats it (see
+  // BroadcastScheduler). Otherwise, one (acknowledged) request per CF.
+  // Must run on the slow thread.
+  void setParams(
+    const XmlRpc::XmlRpcValue& params)
+  {
+    if (m_cfs.empty()) {
+      return;
+    }
+    if (!canBroadcastParams()) {
+      ROS_WARN("[radio %d] No common param TOC within the group; setting parameters per CF", m_radio);
+      for (auto cf : m_cfs) {
+        cf->applyFirmwareParams({params});
+        cf->mirrorParams(params);
+      }
+      return;
+    }
+    broadcastParams(params);
+    for (auto cf : m_cfs) {
+      cf->mirrorParams(params);
+    }
   }
 
-  void updateParams(
-    uint8_t group,
-    const std::vector<std::string>& params)
+
+private:
+  // True if all CFs of this group have an identical param TOC, i.e., the
+  // parameter ids of the first CF are valid for all of them.
+  bool canBroadcastParams() const
   {
-    for (const auto& p : params) {
-      std::string ros_param = "/cfgroup" + std::to_string((int)group) + "/" + p;
-      size_t pos = p.find("/");
-      std::string g(p.begin(), p.begin() + pos);
-      std::string n(p.begin() + pos + 1, p.end());
+    if (m_cfs.empty() || m_cfs.front()->paramTocFingerprint() == 0) {
+      return false;
+    }
+    for (const auto cf : m_cfs) {
+      if (cf->paramTocFingerprint() != m_cfs.front()->paramTocFingerprint()) {
+        return false;
+      }
+    }
+    return true;
+  }
 
-      // TODO: this assumes that all IDs are identically
-      //       should use byName lookup instead!
-      auto entry = m_cfs.front()->getParamTocEntry(g, n);
-      if (entry)
-      {
-        switch (entry->type) {
-          case Crazyflie::ParamTypeUint8:
-            updateParam<uint8_t, int>(group, entry->id, entry->type, ros_param);
-            break;
-          case Crazyflie::ParamTypeInt8:
-            updateParam<int8_t, int>(group, entry->id, entry->type, ros_param);
-            break;
-          case Crazyflie::ParamTypeUint16:
-            updateParam<uint16_t, int>(group, entry->id, entry->type, ros_param);
-            break;
-          case Crazyflie::ParamTypeInt16:
-            updateParam<int16_t, int>(group, entry->id, entry->type, ros_param);
-            break;
-          case Crazyflie::ParamTypeUint32:
-            updateParam<uint32_t, int>(group, entry->id, entry->type, ros_param);
-            break;
-          case Crazyflie::ParamTypeInt32:
-            updateParam<int32_t, int>(group, entry->id, entry->type, ros_param);
-            break;
-          case Crazyflie::ParamTypeFloat:
-            updateParam<float, float>(group, entry->id, entry->type, ros_param);
-            break;
-        }
+  // Schedules the parameter writes as one broadcast command. It neither replaces
+  // nor is replaced by the flight commands. Requires canBroadcastParams().
+  void broadcastParams(
+    const XmlRpc::XmlRpcValue& params)
+  {
+    std::vector<std::function<void()> > writes;
+    forEachParamValue(params, [&](const std::string& group, const std::string& name, double value) {
+      auto entry = m_cfs.front()->getParamTocEntry(group, name);
+      if (!entry) {
+        ROS_ERROR("Could not find param %s/%s", group.c_str(), name.c_str());
+        return;
       }
-      else {
-        ROS_ERROR("Could not find param %s/%s", g.c_str(), n.c_str());
+      uint8_t id = entry->id;
+      switch (entry->type) {
+        case Crazyflie::ParamTypeUint8:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<uint8_t>(id, (uint8_t)value); });
+          break;
+        case Crazyflie::ParamTypeInt8:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<int8_t>(id, (int8_t)value); });
+          break;
+        case Crazyflie::ParamTypeUint16:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<uint16_t>(id, (uint16_t)value); });
+          break;
+        case Crazyflie::ParamTypeInt16:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<int16_t>(id, (int16_t)value); });
+          break;
+        case Crazyflie::ParamTypeUint32:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<uint32_t>(id, (uint32_t)value); });
+          break;
+        case Crazyflie::ParamTypeInt32:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<int32_t>(id, (int32_t)value); });
+          break;
+        case Crazyflie::ParamTypeFloat:
+          writes.push_back([this, id, value] { m_cfbc.writeParam<float>(id, (float)value); });
+          break;
       }
+    });
+    if (writes.empty()) {
+      return;
     }
+    m_commands.schedule("params", 0, m_cfs.size(), [this, writes] {
+      std::lock_guard<std::mutex> lock(m_cfbcMutex);
+      for (const auto& write : writes) {
+        write();
+      }
+    }, BroadcastScheduler::Confirmation(), BroadcastScheduler::clock::now(), /*replaceable*/ false);
   }
-#endif
-
-private:
 
   void publishRigidBody(const std::string& name, uint8_t id, std::vector<CrazyflieBroadcaster::externalPose> &states)
   {
@@ -968,94 +2243,146 @@ private:
 
 
   void readObjects(
+    const SwarmConfig& swarmConfig,
     std::vector<libobjecttracker::Object>& objects,
     int channel,
     const std::vector<crazyflie_driver::LogBlock>& logBlocks)
   {
     // read CF config
-    struct CFConfig
-    {
-      std::string uri;
-      std::string tf_prefix;
-      std::string frame;
-      int idNumber;
-      std::string type;
-    };
-    ros::NodeHandle nGlobal;
-
-    XmlRpc::XmlRpcValue crazyflies;
-    nGlobal.getParam("crazyflies", crazyflies);
-    ROS_ASSERT(crazyflies.getType() == XmlRpc::XmlRpcValue::TypeArray);
-
     objects.clear();
     m_cfs.clear();
+    m_objectConfigs.clear();
     std::vector<CFConfig> cfConfigs;
-    for (int32_t i = 0; i < crazyflies.size(); ++i) {
-      ROS_ASSERT(crazyflies[i].getType() == XmlRpc::XmlRpcValue::TypeStruct);
-      XmlRpc::XmlRpcValue crazyflie = crazyflies[i];
-      int id = crazyflie["id"];
-      int ch = crazyflie["channel"];
-      std::string type = crazyflie["type"];
-      if (ch == channel) {
-        XmlRpc::XmlRpcValue pos = crazyflie["initialPosition"];
-        ROS_ASSERT(pos.getType() == XmlRpc::XmlRpcValue::TypeArray);
-
-        std::vector<double> posVec(3);
-        for (int32_t j = 0; j < pos.size(); ++j) {
-          ROS_ASSERT(pos[j].getType() == XmlRpc::XmlRpcValue::TypeDouble);
-          double f = static_cast<double>(pos[j]);
-          posVec[j] = f;
-        }
+    for (const auto& crazyflie : swarmConfig.crazyflies) {
+      if (crazyflie.channel == channel) {
+        const auto& pos = crazyflie.initialPosition;
         Eigen::Affine3f m;
-        m = Eigen::Translation3f(posVec[0], posVec[1], posVec[2]);
-        int markerConfigurationIdx;
-        nGlobal.getParam("crazyflieTypes/" + type + "/markerConfiguration", markerConfigurationIdx);
-        int dynamicsConfigurationIdx;
-        nGlobal.getParam("crazyflieTypes/" + type + "/dynamicsConfiguration", dynamicsConfigurationIdx);
-        objects.push_back(libobjecttracker::Object(markerConfigurationIdx, dynamicsConfigurationIdx, m));
-
-        std::stringstream sstr;
-        sstr << std::setfill ('0') << std::setw(2) << std::hex << id;
-        std::string idHex = sstr.str();
-
-        std::string uri = "radio://" + std::to_string(m_radio) + "/" + std::to_string(channel) + "/2M/E7E7E7E7" + idHex;
-        std::string tf_prefix = "cf" + std::to_string(id);
-        std::string frame = "cf" + std::to_string(id);
-        cfConfigs.push_back({uri, tf_prefix, frame, id, type});
+        m = Eigen::Translation3f(pos[0], pos[1], pos[2]);
+        const SwarmConfig::TypeConfig& typeConfig = swarmConfig.type(crazyflie.type);
+        objects.push_back(libobjecttracker::Object(typeConfig.markerConfiguration, typeConfig.dynamicsConfiguration, m));
+        m_objectConfigs.push_back(std::make_pair(typeConfig.markerConfiguration, typeConfig.dynamicsConfiguration));
+        cfConfigs.push_back(cfConfig(crazyflie.id, crazyflie.type));
       }
     }
 
+    ros::NodeHandle nl("~");
+    // number of CFs of this group that are brought up at the same time;
+    // their requests are interleaved on the radio (1: one CF after the other)
+    int bringupConcurrency;
+    nl.param<int>("bringup_concurrency", bringupConcurrency, 4);
+
+    auto startBringup = std::chrono::high_resolution_clock::now();
+
     // Turn all CFs on
-    for (const auto& config : cfConfigs) {
-      Crazyflie cf(config.uri);
+    parallelFor(cfConfigs.size(), bringupConcurrency, [&](size_t idx) {
+      auto scope = m_tracer->track(m_radio, cfConfigs[idx].frame).scope("syson");
+      Crazyflie cf(cfConfigs[idx].uri);
       cf.syson();
       for (size_t i = 0; i < 50; ++i) {
         cf.sendPing();
       }
+    });
+
+    nl.getParam("enable_logging", m_bringup.enableLogging);
+    nl.getParam("enable_parameters", m_bringup.enableParameters);
+    nl.getParam("force_no_cache", m_bringup.forceNoCache);
+    nl.param<bool>("publish_shared_log_data", m_bringup.publishSharedLogData, false);
+    m_bringup.logBlocks = logBlocks;
+
+    // share the radio bandwidth between pose broadcast and logging
+    nl.param<double>("radio_packets_per_second", m_bringup.radioPacketsPerSecond, 1000.0);
+    nl.param<double>("motion_capture_frequency", m_bringup.motionCaptureFrequency, 100.0);
+    m_logPlan = planLogs(cfConfigs.size());
+    if (m_bringup.enableLogging) {
+      ROS_INFO("[radio %d] %s", m_radio, LogBandwidthPlanner::summary(m_logPlan).c_str());
     }
 
-    ros::NodeHandle nl("~");
-    bool enableLogging;
-    bool enableParameters;
-    bool forceNoCache;
+    // firmwareParams for all CFs ("") and per type; read once for the whole group
+    nl.getParam("firmwareParams", m_bringup.firmwareParams[""]);
+    for (const auto& config : cfConfigs) {
+      addFirmwareParams(config.type);
+    }
 
-    nl.getParam("enable_logging", enableLogging);
-    nl.getParam("enable_parameters", enableParameters);
-    nl.getParam("force_no_cache", forceNoCache);
+    // add Crazyflies (keeping the order of objects); if one fails, the ones that
+    // were brought up are disconnected again
+    std::vector<CrazyflieROS*> cfs(cfConfigs.size(), nullptr);
+    try {
+      parallelFor(cfConfigs.size(), bringupConcurrency, [&](size_t idx) {
+        cfs[idx] = bringup(cfConfigs[idx], m_logPlan);
+      });
+    } catch (...) {
+      for (auto cf : cfs) {
+        delete cf;
+      }
+      throw;
+    }
+    m_cfs = cfs;
 
-    // add Crazyflies
-    for (const auto& config : cfConfigs) {
-      addCrazyflie(config.uri, config.tf_prefix, config.frame, "/world", enableParameters, enableLogging, config.idNumber, config.type, logBlocks, forceNoCache);
+    std::chrono::duration<double> elapsedBringup = std::chrono::high_resolution_clock::now() - startBringup;
+    ROS_INFO("[radio %d] Bring-up of %zu CFs took %f s (bringup_concurrency: %d)",
+      m_radio, m_cfs.size(), elapsedBringup.count(), bringupConcurrency);
+  }
 
-      auto start = std::chrono::high_resolution_clock::now();
-      updateParams(m_cfs.back());
-      auto end = std::chrono::high_resolution_clock::now();
-      std::chrono::duration<double> elapsed = end - start;
-      ROS_INFO("Update params: %f s", elapsed.count());
+  struct CFConfig
+  {
+    std::string uri;
+    std::string tf_prefix;
+    std::string frame;
+    int idNumber;
+    std::string type;
+  };
+
+  CFConfig cfConfig(
+    int id,
+    const std::string& type) const
+  {
+    std::stringstream sstr;
+    sstr << std::setfill ('0') << std::setw(2) << std::hex << id;
+    std::string idHex = sstr.str();
+
+    std::string uri = "radio://" + std::to_string(m_radio) + "/" + std::to_string(m_channel) + "/2M/E7E7E7E7" + idHex;
+    std::string tf_prefix = "cf" + std::to_string(id);
+    std::string frame = "cf" + std::to_string(id);
+    return {uri, tf_prefix, frame, id, type};
+  }
+
+  // Log bandwidth plan for the given number of CFs on this radio
+  LogBandwidthPlanner::Plan planLogs(
+    size_t numCFs) const
+  {
+    LogBandwidthPlanner planner(m_bringup.radioPacketsPerSecond, m_bringup.motionCaptureFrequency, m_sendPositionOnly ? 4 : 2);
+    std::vector<std::pair<std::string, double> > requestedLogRates;
+    for (const auto& logBlock : m_bringup.logBlocks) {
+      requestedLogRates.push_back(std::make_pair(logBlock.topic_name, (double)logBlock.frequency));
+    }
+    return planner.plan(numCFs, requestedLogRates);
+  }
+
+  void addFirmwareParams(
+    const std::string& type)
+  {
+    if (m_bringup.firmwareParams.find(type) == m_bringup.firmwareParams.end()) {
+      XmlRpc::XmlRpcValue& params = m_bringup.firmwareParams[type];
+      for (const auto& param : m_swarmConfig.type(type).firmwareParams) {
+        params[param.group][param.name] = param.value;
+      }
     }
   }
 
-  void addCrazyflie(
+  // Connects to a CF that is already turned on (TOCs, log blocks, parameters)
+  CrazyflieROS* bringup(
+    const CFConfig& config,
+    const LogBandwidthPlanner::Plan& logPlan)
+  {
+    auto track = m_tracer->track(m_radio, config.frame);
+    CrazyflieROS* cf = addCrazyflie(config.uri, config.tf_prefix, config.frame, "/world", m_bringup.enableParameters, m_bringup.enableLogging, config.idNumber, config.type, m_bringup.logBlocks, m_bringup.forceNoCache, m_bringup.publishSharedLogData, logPlan, track);
+
+    auto scope = track.scope("updateParams");
+    scope.arg("params", updateParams(cf, m_bringup.firmwareParams));
+    return cf;
+  }
+
+  CrazyflieROS* addCrazyflie(
     const std::string& uri,
     const std::string& tf_prefix,
     const std::string& frame,
@@ -1065,10 +2392,13 @@ private:
     int id,
     const std::string& type,
     const std::vector<crazyflie_driver::LogBlock>& logBlocks,
-    bool forceNoCache)
+    bool forceNoCache,
+    bool publishSharedLogData,
+    const LogBandwidthPlanner::Plan& logPlan,
+    const StartupTracer::Track& track)
   {
     ROS_INFO("Adding CF: %s (%s, %s)...", tf_prefix.c_str(), uri.c_str(), frame.c_str());
-    auto start = std::chrono::high_resolution_clock::now();
+    auto scope = track.scope("ctor");
     CrazyflieROS* cf = new CrazyflieROS(
       uri,
       tf_prefix,
@@ -1080,76 +2410,247 @@ private:
       type,
       logBlocks,
       m_slowQueue,
-      forceNoCache);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    ROS_INFO("CF ctor: %f s", elapsed.count());
-    cf->run(m_slowQueue);
-    auto end2 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed2 = end2 - end;
-    ROS_INFO("CF run: %f s", elapsed2.count());
-    m_cfs.push_back(cf);
-  }
-
-  void updateParams(
-    CrazyflieROS* cf)
-  {
-    ros::NodeHandle n("~");
-    ros::NodeHandle nGlobal;
-    // update parameters
-    // std::cout << "attempt: " << "firmwareParams/" + cf->type() << std::endl;
-    // char dummy;
-    // std::cin >> dummy;
-
-    // update global and type-specific parameters
-    std::vector<std::string> paramLocations;
-    paramLocations.push_back("firmwareParams");
-    paramLocations.push_back("crazyflieTypes/" + cf->type() + "/firmwareParams");
-
-    crazyflie_driver::UpdateParams::Request request;
-    crazyflie_driver::UpdateParams::Response response;
-
-    for (const auto& paramLocation : paramLocations) {
-      XmlRpc::XmlRpcValue firmwareParams;
-      if (paramLocation == "firmwareParams") {
-        n.getParam(paramLocation, firmwareParams);
-      } else {
-        nGlobal.getParam(paramLocation, firmwareParams);
-      }
-
-      // ROS_ASSERT(firmwareParams.getType() == XmlRpc::XmlRpcValue::TypeArray);
-      auto iter = firmwareParams.begin();
-      for (; iter != firmwareParams.end(); ++iter) {
-        std::string group = iter->first;
-        XmlRpc::XmlRpcValue v = iter->second;
-        auto iter2 = v.begin();
-        for (; iter2 != v.end(); ++iter2) {
-          std::string param = iter2->first;
-          XmlRpc::XmlRpcValue value = iter2->second;
-          if (value.getType() == XmlRpc::XmlRpcValue::TypeBoolean) {
-            bool b = value;
-            nGlobal.setParam(cf->frame() + "/" + group + "/" + param, b);
-            std::cout << "update " << group + "/" + param << " to " << b << std::endl;
-          } else if (value.getType() == XmlRpc::XmlRpcValue::TypeInt) {
-            int b = value;
-            nGlobal.setParam(cf->frame() + "/" + group + "/" + param, b);
-            std::cout << "update " << group + "/" + param << " to " << b << std::endl;
-          } else if (value.getType() == XmlRpc::XmlRpcValue::TypeDouble) {
-            double b = value;
-            nGlobal.setParam(cf->frame() + "/" + group + "/" + param, b);
-            std::cout << "update " << group + "/" + param << " to " << b << std::endl;
-          } else {
-            ROS_WARN("No known type for %s.%s!", group.c_str(), param.c_str());
+      forceNoCache,
+      publishSharedLogData,
+      m_telemetry,
+      m_tocCache,
+      m_feasibility);
+    scope.end();
+    cf->run(m_slowQueue, logPlan, track);
+    return cf;
+  }
+
+  // Applies the global and type-specific firmwareParams (straight from the
+  // YAML configuration, without a round trip through the parameter server)
+  // and mirrors all parameters of the CF to the parameter server.
+  // Returns the number of parameters set.
+  size_t updateParams(
+    CrazyflieROS* cf,
+    const std::map<std::string, XmlRpc::XmlRpcValue>& firmwareParams)
+  {
+    std::vector<XmlRpc::XmlRpcValue> params;
+    auto global = firmwareParams.find("");
+    if (global != firmwareParams.end()) {
+      params.push_back(global->second);
+    }
+    auto typeSpecific = firmwareParams.find(cf->type());
+    if (typeSpecific != firmwareParams.end()) {
+      params.push_back(typeSpecific->second);
+    }
+    size_t numParams = cf->applyFirmwareParams(params);
+    cf->publishParams();
+    return numParams;
+  }
+
+private:
+  // see CrazyflieROS::setExecution
+  void setExecution(
+    uint8_t groupMask,
+    int trajectoryId,
+    float timescale)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto cf : m_cfs) {
+      if (groupMask == 0 || (cf->groupMask() & groupMask)) {
+        cf->setExecution(trajectoryId, timescale);
+      }
+    }
+  }
+
+  // A CF confirms a command once the logged counter of received commands
+  // (m_ackVariable) reached the latest logged value + 1, and passed the value that
+  // confirmed the previous command (whose packets may not be logged yet). Not
+  // available if the counter is not logged.
+  CommandSent scheduleCommand(
+    const std::string& name,
+    uint8_t groupMask,
+    std::function<void()> send,
+    BroadcastScheduler::clock::time_point startTime)
+  {
+    if (m_isEmergency) {
+      // refused like by the closed scheduler (emergency() may not have closed it yet)
+      std::promise<BroadcastScheduler::clock::time_point> refused;
+      return refused.get_future();
+    }
+    BroadcastScheduler::Confirmation confirmation;
+    size_t numCFs;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      numCFs = m_cfs.size();
+      if (m_telemetry && !m_ackVariable.empty()) {
+        std::vector<std::pair<int, double> > thresholds;
+        for (const auto cf : m_cfs) {
+          double time;
+          double value;
+          if (m_telemetry->latest(cf->id(), m_ackVariable, time, value)) {
+            AckThreshold& previous = m_ackThresholds[cf->id()];
+            double threshold = value + 1;
+            // (a counter that went back was reset by a reboot)
+            if (value >= previous.value && previous.threshold + 1 > threshold) {
+              threshold = previous.threshold + 1;
+            }
+            previous = AckThreshold{value, threshold};
+            thresholds.push_back(std::make_pair(cf->id(), threshold));
           }
-          request.params.push_back(group + "/" + param);
+        }
+        if (!thresholds.empty()) {
+          TelemetryStore* telemetry = m_telemetry;
+          std::string variable = m_ackVariable;
+          confirmation = [telemetry, variable, thresholds]() {
+            int confirmed = 0;
+            for (const auto& threshold : thresholds) {
+              double time;
+              double value;
+              if (telemetry->latest(threshold.first, variable, time, value) && value >= threshold.second) {
+                ++confirmed;
+              }
+            }
+            return confirmed;
+          };
+        }
+      }
+    }
+    // a high-level command from the server overrides the streamed trajectories
+    ++m_commandGeneration;
+    return m_commands.schedule(name, groupMask, numCFs, send, confirmation, startTime);
+  }
+
+  CrazyflieROS* crazyflie(int id) const
+  {
+    for (auto cf : m_cfs) {
+      if (cf->id() == id) {
+        return cf;
+      }
+    }
+    return nullptr;
+  }
 
+  // Starts the segments that are due first (timing), then uploads at most one
+  // segment per tick, so that an upload delays the other CFs' starts by at
+  // most its own duration. A start that is due before the next tick is sent at
+  // its send time (see TrajectoryStream::sendTime) instead of up to a tick late.
+  void onStreamTimer(const ros::WallTimerEvent& e)
+  {
+    auto now = TrajectoryStream::clock::now();
+    for (auto iter = m_streams.begin(); iter != m_streams.end();) {
+      CrazyflieROS* cf = crazyflie(iter->first);
+      TrajectoryStream& stream = *iter->second.stream;
+      const char* reason = nullptr;
+      if (!cf) {
+        reason = "removed";
+      } else if (m_isEmergency || iter->second.generation != m_commandGeneration
+          || iter->second.numCommands != cf->numCommands()) {
+        reason = "cancelled";
+      } else if (stream.finished(now)) {
+        reason = "finished";
+      } else {
+        auto nextTick = now + std::chrono::duration_cast<TrajectoryStream::clock::duration>(
+          std::chrono::duration<double>(StreamTimerPeriod));
+        int k = stream.nextStart(nextTick);
+        if (k >= 0) {
+          try {
+            std::this_thread::sleep_until(stream.sendTime(k));
+            auto sent = TrajectoryStream::clock::now();
+            cf->startTrajectory(stream.trajectoryId(k), stream.settings().timescale);
+            double latency = std::chrono::duration<double>(TrajectoryStream::clock::now() - sent).count() / 2;
+            stream.started(k, sent, latency);
+          } catch (std::exception& e) {
+            ROS_ERROR("[%s] Could not start trajectory segment: %s", cf->frame().c_str(), e.what());
+            reason = "failed";
+          }
         }
       }
+      if (reason) {
+        ROS_INFO("[cf%d] Trajectory stream %s (%zu segments, %zu late starts, %.3f s held)",
+          iter->first, reason, stream.numSegments(), stream.numLateStarts(), stream.waited());
+        iter = m_streams.erase(iter);
+      } else {
+        ++iter;
+      }
+    }
+
+    // the segment that starts first
+    CrazyflieROS* next = nullptr;
+    TrajectoryStream* nextStream = nullptr;
+    int nextSegment = -1;
+    for (auto& entry : m_streams) {
+      TrajectoryStream* stream = entry.second.stream.get();
+      int k = stream->nextUpload(now);
+      if (k >= 0 && (!nextStream || stream->segment(k).start < nextStream->segment(nextSegment).start)) {
+        next = crazyflie(entry.first);
+        nextStream = stream;
+        nextSegment = k;
+      }
+    }
+    if (nextStream) {
+      try {
+        next->uploadTrajectory(nextStream->trajectoryId(nextSegment), nextStream->pieceOffset(nextSegment),
+          nextStream->pieces(nextSegment), false);
+        nextStream->uploaded(nextSegment);
+      } catch (std::exception& e) {
+        ROS_ERROR("[%s] Could not upload trajectory segment: %s", next->frame().c_str(), e.what());
+      }
+    }
+
+    if (m_streams.empty()) {
+      m_streamTimer.stop();
     }
-    cf->updateParams(request, response);
   }
 
-private:
+  // Probability that a single broadcast reaches a CF, estimated from the link
+  // quality of the unicast connections. Clamped, since broadcasts are not
+  // retried by the radio and the estimate can be stale.
+  double broadcastLinkQuality() const
+  {
+    double linkQuality = 0.9;
+    for (const auto cf : m_cfs) {
+      linkQuality = std::min<double>(linkQuality, cf->linkQuality());
+    }
+    return std::max(linkQuality, 0.1);
+  }
+
+  // log data arrives in the ACKs of our pings; stagger the CFs so
+  // that they don't all compete for the radio in the same tick
+  void onPingTimer(const ros::WallTimerEvent& e)
+  {
+    for (size_t i = 0; i < m_cfs.size(); ++i) {
+      if ((m_pingTick + i) % m_logPlan.pingPeriodTicks == 0) {
+        m_cfs[i]->sendPing();
+      }
+    }
+    ++m_pingTick;
+    m_commands.setLinkQuality(broadcastLinkQuality());
+
+    auto now = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> sinceReport = now - m_lastLogRateReport;
+    if (m_logRateReportPeriod > 0 && sinceReport.count() >= m_logRateReportPeriod) {
+      for (const auto& cf : m_cfs) {
+        cf->reportLogRates(sinceReport.count(), m_logPlan);
+      }
+      m_lastLogRateReport = now;
+    }
+  }
+
+  // A task of runOnSlowThread in the slow queue
+  class SlowTask : public ros::CallbackInterface
+  {
+  public:
+    SlowTask(
+      std::packaged_task<bool()>&& task)
+      : m_task(std::move(task))
+    {
+    }
+
+    virtual CallResult call()
+    {
+      m_task();
+      return Success;
+    }
+
+  private:
+    std::packaged_task<bool()> m_task;
+  };
+
   std::vector<CrazyflieROS*> m_cfs;
   std::string m_interactiveObject;
   libobjecttracker::ObjectTracker* m_tracker;
@@ -1158,8 +2659,11 @@ private:
   pcl::PointCloud<pcl::PointXYZ>::Ptr m_pMarkers;
   std::vector<libmotioncapture::Object>* m_pMocapObjects;
   ros::CallbackQueue m_slowQueue;
-  CrazyflieBroadcaster m_cfbc;
-  bool m_isEmergency;
+  TrajectoryBroadcaster m_cfbc;
+  // the fast loop, the slow thread, the emergency thread and the scheduler's
+  // thread all broadcast; one packet at a time
+  std::mutex m_cfbcMutex;
+  std::atomic<bool> m_isEmergency;
   bool m_useMotionCaptureObjectTracking;
   tf::TransformBroadcaster m_br;
   latency m_latency;
@@ -1167,14 +2671,74 @@ private:
   std::vector<std::unique_ptr<std::ofstream>> m_outputCSVs;
   int m_phase;
   std::chrono::high_resolution_clock::time_point m_phaseStart;
+  LogBandwidthPlanner::Plan m_logPlan;
+  TelemetryStore* m_telemetry;
+  TocCache* m_tocCache;
+  const FeasibilityChecker* m_feasibility;
+  StartupTracer* m_tracer;
+  const SwarmConfig& m_swarmConfig;
+  int m_channel;
+  std::vector<libobjecttracker::DynamicsConfiguration> m_dynamicsConfigurations;
+  std::vector<libobjecttracker::MarkerConfiguration> m_markerConfigurations;
+  // marker and dynamics configuration of each CF (same order as m_cfs)
+  std::vector<std::pair<int, int> > m_objectConfigs;
+
+  // settings to bring up a CF (also used for CFs added later)
+  struct BringupSettings
+  {
+    bool enableParameters;
+    bool enableLogging;
+    bool forceNoCache;
+    bool publishSharedLogData;
+    std::vector<crazyflie_driver::LogBlock> logBlocks;
+    // see planLogs
+    double radioPacketsPerSecond;
+    double motionCaptureFrequency;
+    // firmwareParams for all CFs ("") and per type
+    std::map<std::string, XmlRpc::XmlRpcValue> firmwareParams;
+  };
+  BringupSettings m_bringup;
+
+  // m_cfs, m_objectConfigs, m_tracker and m_outputCSVs are only changed on the
+  // slow thread, while the server thread waits (see runOnSlowThread). m_mutex
+  // protects them against the fast loop.
+  std::mutex m_mutex;
+  std::mutex m_slowThreadMutex;
+  bool m_slowThreadRunning;
+  BroadcastScheduler m_commands;
+  std::string m_ackVariable;
+  // per CF: logged counter value and the value that confirms the last command (see scheduleCommand)
+  struct AckThreshold
+  {
+    double value;
+    double threshold;
+  };
+  std::map<int, AckThreshold> m_ackThresholds;
+  // see onPingTimer
+  uint32_t m_pingTick;
+  std::chrono::high_resolution_clock::time_point m_lastLogRateReport;
+  double m_logRateReportPeriod;
+  // trajectory streams by CF id (see onStreamTimer), only used on the slow thread
+  struct StreamState
+  {
+    std::unique_ptr<TrajectoryStream> stream;
+    uint32_t generation;   // of the swarm commands (m_commandGeneration)
+    uint32_t numCommands;  // of the CF's own commands (CrazyflieROS::numCommands)
+  };
+  static constexpr double StreamTimerPeriod = 0.005;
+  std::map<int, StreamState> m_streams;
+  ros::WallTimer m_streamTimer;
+  std::atomic<uint32_t> m_commandGeneration;
 };
 
 // handles all Crazyflies
 class CrazyflieServer
 {
 public:
-  CrazyflieServer()
-    : m_isEmergency(false)
+  CrazyflieServer(
+    const SwarmConfig& swarmConfig)
+    : m_swarmConfig(swarmConfig)
+    , m_isEmergency(false)
     , m_serviceEmergency()
     , m_serviceStartTrajectory()
     , m_serviceTakeoff()
@@ -1183,18 +2747,50 @@ public:
     , m_lastInteractiveObjectPosition(-10, -10, 1)
     , m_broadcastingNumRepeats(15)
     , m_broadcastingDelayBetweenRepeatsMs(1)
+    , m_broadcastingDispatchLeadUs(1000)
+    , m_broadcastingConfidence(0.999)
+    , m_trajectoryBroadcastRepeats(8)
+    , m_trajectoryBroadcastPacketDelayUs(500)
+    , m_trajectoryChecksumVariable()
+    , m_trajectoryMaxError(0)
+    , m_feasibility()
+    , m_telemetry()
+    , m_tocCache()
+    , m_startupTracer()
   {
     ros::NodeHandle nh;
     nh.setCallbackQueue(&m_queue);
 
-    m_serviceEmergency = nh.advertiseService("emergency", &CrazyflieServer::emergency, this);
+    ros::NodeHandle nl("~");
+    bool enableLogging;
+    double telemetryWindow;
+    nl.getParam("enable_logging", enableLogging);
+    nl.param<double>("telemetry_window", telemetryWindow, 10.0);
+    if (enableLogging && telemetryWindow > 0) {
+      m_telemetry.reset(new TelemetryStore(telemetryWindow));
+    }
+
+    std::string tocCacheIndex;
+    nl.param<std::string>("toc_cache_index", tocCacheIndex, "tocCache.csv");
+    m_tocCache.reset(new TocCache(tocCacheIndex));
+
+    ros::NodeHandle ne;
+    ne.setCallbackQueue(&m_emergencyQueue);
+    m_serviceEmergency = ne.advertiseService("emergency", &CrazyflieServer::emergency, this);
     m_serviceStartTrajectory = nh.advertiseService("start_trajectory", &CrazyflieServer::startTrajectory, this);
     m_serviceTakeoff = nh.advertiseService("takeoff", &CrazyflieServer::takeoff, this);
     m_serviceLand = nh.advertiseService("land", &CrazyflieServer::land, this);
     m_serviceStop = nh.advertiseService("stop", &CrazyflieServer::stop, this);
 
     m_serviceNextPhase = nh.advertiseService("next_phase", &CrazyflieServer::nextPhase, this);
-    // m_serviceUpdateParams = nh.advertiseService("update_params", &CrazyflieServer::updateParams, this);
+    m_serviceQueryTelemetry = nh.advertiseService("query_telemetry", &CrazyflieServer::queryTelemetry, this);
+    m_serviceUpdateParams = nh.advertiseService("update_params", &CrazyflieServer::updateParams, this);
+    m_serviceAddCrazyflie = nh.advertiseService("add_crazyflie", &CrazyflieServer::addCrazyflie, this);
+    m_serviceRemoveCrazyflie = nh.advertiseService("remove_crazyflie", &CrazyflieServer::removeCrazyflie, this);
+    m_serviceReplaceCrazyflie = nh.advertiseService("replace_crazyflie", &CrazyflieServer::replaceCrazyflie, this);
+    m_serviceUploadTrajectory = nh.advertiseService("upload_trajectory", &CrazyflieServer::uploadTrajectory, this);
+    m_serviceStreamTrajectory = nh.advertiseService("stream_trajectory", &CrazyflieServer::streamTrajectory, this);
+    m_serviceUploadNN = nh.advertiseService("upload_nn", &CrazyflieServer::uploadNN, this);
 
     m_pubPointCloud = nh.advertise<sensor_msgs::PointCloud>("pointCloud", 1);
 
@@ -1219,8 +2815,10 @@ public:
   void run()
   {
     std::thread tSlow(&CrazyflieServer::runSlow, this);
+    std::thread tEmergency(&CrazyflieServer::runEmergency, this);
     runFast();
     tSlow.join();
+    tEmergency.join();
   }
 
   void runFast()
@@ -1245,11 +2843,10 @@ public:
 
     std::vector<libobjecttracker::DynamicsConfiguration> dynamicsConfigurations;
     std::vector<libobjecttracker::MarkerConfiguration> markerConfigurations;
-    std::set<int> channels;
+    std::set<int> channels = m_swarmConfig.channels();
 
-    readMarkerConfigurations(markerConfigurations);
-    readDynamicsConfigurations(dynamicsConfigurations);
-    readChannels(channels);
+    convertMarkerConfigurations(markerConfigurations);
+    convertDynamicsConfigurations(dynamicsConfigurations);
 
     std::string broadcastAddress;
     bool useMotionCaptureObjectTracking;
@@ -1271,8 +2868,29 @@ public:
     nl.getParam("write_csvs", writeCSVs);
     nl.param<std::string>("motion_capture_type", motionCaptureType, "vicon");
 
+    std::string startupTrace;
+    nl.param<std::string>("startup_trace", startupTrace, "startupTrace.json");
+
     nl.param<int>("broadcasting_num_repeats", m_broadcastingNumRepeats, 15);
     nl.param<int>("broadcasting_delay_between_repeats_ms", m_broadcastingDelayBetweenRepeatsMs, 1);
+    nl.param<int>("broadcasting_dispatch_lead_us", m_broadcastingDispatchLeadUs, 1000);
+    nl.param<int>("trajectory_broadcast_repeats", m_trajectoryBroadcastRepeats, 8);
+    nl.param<int>("trajectory_broadcast_packet_delay_us", m_trajectoryBroadcastPacketDelayUs, 500);
+    nl.param<std::string>("trajectory_checksum_variable", m_trajectoryChecksumVariable, "trajMem.checksum");
+    nl.param<double>("trajectory_encoding_max_error", m_trajectoryMaxError, 0);
+    readFeasibilityLimits(nl);
+
+    // takeoff, land, stop, startTrajectory (see BroadcastScheduler)
+    BroadcastScheduler::Settings broadcastSettings;
+    int broadcastingRepeatsPerFrame;
+    nl.param<int>("broadcasting_repeats_per_frame", broadcastingRepeatsPerFrame, 2);
+    nl.param<double>("broadcasting_deadline", broadcastSettings.deadline, 0.5);
+    nl.param<double>("broadcasting_confidence", broadcastSettings.confidence, 0.999);
+    broadcastSettings.maxRepeats = m_broadcastingNumRepeats;
+    broadcastSettings.repeatsPerFrame = broadcastingRepeatsPerFrame;
+    m_broadcastingConfidence = broadcastSettings.confidence;
+    std::string broadcastingAckVariable;
+    nl.param<std::string>("broadcasting_ack_variable", broadcastingAckVariable, "chlDbg.numCmdsRcvd");
 
     std::string firmware;
     nl.param<std::string>("firmware", firmware, "crazyswarm");
@@ -1374,6 +2992,7 @@ public:
             {
               // std::cout << "radio: " << radio << std::endl;
               return new CrazyflieGroup(
+                m_swarmConfig,
                 dynamicsConfigurations,
                 markerConfigurations,
                 // &client,
@@ -1386,7 +3005,13 @@ public:
                 logBlocks,
                 interactiveObject,
                 writeCSVs,
-                sendPositionOnly);
+                sendPositionOnly,
+                broadcastSettings,
+                broadcastingAckVariable,
+                m_telemetry.get(),
+                m_tocCache.get(),
+                &m_feasibility,
+                &m_startupTracer);
             },
             channel,
             r
@@ -1399,6 +3024,12 @@ public:
         m_groups.push_back(handle.get());
       }
     }
+    ROS_INFO("%s", m_tocCache->summary().c_str());
+    ROS_INFO("%s", m_startupTracer.summary(5).c_str());
+    if (!startupTrace.empty()) {
+      m_startupTracer.writeChromeTrace(startupTrace);
+      ROS_INFO("Wrote startup trace to %s (open in chrome://tracing or ui.perfetto.dev)", startupTrace.c_str());
+    }
 
     // start the groups threads
     std::vector<std::thread> threads;
@@ -1583,8 +3214,16 @@ public:
   void runSlow()
   {
     while(ros::ok() && !m_isEmergency) {
-      m_queue.callAvailable(ros::WallDuration(0));
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      // the timeout only bounds the time to notice a shutdown
+      m_queue.callAvailable(ros::WallDuration(0.1));
+    }
+  }
+
+  // Only the emergency service, so that it never waits behind other services
+  void runEmergency()
+  {
+    while(ros::ok() && !m_isEmergency) {
+      m_emergencyQueue.callAvailable(ros::WallDuration(0.1));
     }
   }
 
@@ -1594,11 +3233,19 @@ private:
     std_srvs::Empty::Request& req,
     std_srvs::Empty::Response& res)
   {
-    ROS_FATAL("Emergency requested!");
+    auto trigger = std::chrono::high_resolution_clock::now();
+    m_isEmergency = true;
+
+    // all radios at the same time
+    std::vector<std::future<double> > latencies;
     for (auto& group : m_groups) {
-      group->emergency();
+      latencies.push_back(std::async(std::launch::async, &CrazyflieGroup::emergency, group, trigger,
+        m_broadcastingNumRepeats, std::chrono::milliseconds(m_broadcastingDelayBetweenRepeatsMs)));
+    }
+    ROS_FATAL("Emergency requested!");
+    for (size_t i = 0; i < latencies.size(); ++i) {
+      ROS_FATAL("[radio %d] stop sent %.3f ms after the request", m_groups[i]->radio(), latencies[i].get() * 1000);
     }
-    m_isEmergency = true;
 
     return true;
   }
@@ -1609,12 +3256,9 @@ private:
   {
     ROS_INFO("Takeoff!");
 
-    for (size_t i = 0; i < m_broadcastingNumRepeats; ++i) {
-      for (auto& group : m_groups) {
-        group->takeoff(req.height, req.duration.toSec(), req.groupMask);
-      }
-      std::this_thread::sleep_for(std::chrono::milliseconds(m_broadcastingDelayBetweenRepeatsMs));
-    }
+    dispatch("takeoff", [&](CrazyflieGroup* group, BroadcastScheduler::clock::time_point startTime) {
+      return group->takeoff(req.height, req.duration.toSec(), req.groupMask, startTime);
+    });
 
     return true;
   }
@@ -1625,12 +3269,9 @@ private:
   {
     ROS_INFO("Land!");
 
-    for (size_t i = 0; i < m_broadcastingNumRepeats; ++i) {
-      for (auto& group : m_groups) {
-        group->land(req.height, req.duration.toSec(), req.groupMask);
-      }
-      std::this_thread::sleep_for(std::chrono::milliseconds(m_broadcastingDelayBetweenRepeatsMs));
-    }
+    dispatch("land", [&](CrazyflieGroup* group, BroadcastScheduler::clock::time_point startTime) {
+      return group->land(req.height, req.duration.toSec(), req.groupMask, startTime);
+    });
 
     return true;
   }
@@ -1641,12 +3282,9 @@ private:
   {
     ROS_INFO("Stop!");
 
-    for (size_t i = 0; i < m_broadcastingNumRepeats; ++i) {
-      for (auto& group : m_groups) {
-        group->stop(req.groupMask);
-      }
-      std::this_thread::sleep_for(std::chrono::milliseconds(m_broadcastingDelayBetweenRepeatsMs));
-    }
+    dispatch("stop", [&](CrazyflieGroup* group, BroadcastScheduler::clock::time_point startTime) {
+      return group->stop(req.groupMask, startTime);
+    });
 
     return true;
   }
@@ -1657,12 +3295,20 @@ private:
   {
     ROS_INFO("Start trajectory!");
 
-    for (size_t i = 0; i < m_broadcastingNumRepeats; ++i) {
-      for (auto& group : m_groups) {
-        group->startTrajectory(req.trajectoryId, req.timescale, req.reversed, req.groupMask);
-      }
-      std::this_thread::sleep_for(std::chrono::milliseconds(3));
+    // every upload records the fastest feasible timescale per CF (see CrazyflieROS::recordTrajectory)
+    double minTimescale = 0;
+    for (auto group : m_groups) {
+      minTimescale = std::max(minTimescale, group->minTimescale(req.trajectoryId, req.groupMask));
     }
+    if (req.timescale < minTimescale) {
+      ROS_ERROR("Trajectory %d is not feasible with timescale %f (fastest feasible timescale %f)",
+        req.trajectoryId, req.timescale, minTimescale);
+      return false;
+    }
+
+    dispatch("startTrajectory", [&](CrazyflieGroup* group, BroadcastScheduler::clock::time_point startTime) {
+      return group->startTrajectory(req.trajectoryId, req.timescale, req.reversed, req.groupMask, startTime);
+    });
 
     return true;
   }
@@ -1678,96 +3324,470 @@ private:
 
     return true;
   }
-#if 0
+
+  bool queryTelemetry(
+    crazyswarm::QueryTelemetry::Request& req,
+    crazyswarm::QueryTelemetry::Response& res)
+  {
+    if (!m_telemetry) {
+      ROS_WARN("Telemetry store disabled (requires enable_logging and telemetry_window > 0)!");
+      return false;
+    }
+
+    std::vector<int> ids(req.ids.begin(), req.ids.end());
+    if (ids.empty()) {
+      m_telemetry->ids(ids);
+    }
+    double duration = m_telemetry->windowSeconds();
+    if (req.duration > 0) {
+      duration = std::min<double>(req.duration, duration);
+    }
+    double tStart = ros::WallTime::now().toSec() - duration;
+
+    std::vector<double> times;
+    std::vector<double> values;
+    std::vector<double> allValues;
+    for (int id : ids) {
+      times.clear();
+      values.clear();
+      if (!m_telemetry->window(id, req.variable, tStart, times, values)) {
+        continue;
+      }
+      // aggregates use all samples, not the downsampled ones
+      auto stats = TelemetryStore::stats(values);
+      allValues.insert(allValues.end(), values.begin(), values.end());
+      TelemetryStore::downsample(times, values, req.maxSamples);
+
+      res.ids.push_back(id);
+      res.offsets.push_back(res.times.size());
+      res.times.insert(res.times.end(), times.begin(), times.end());
+      res.values.insert(res.values.end(), values.begin(), values.end());
+      res.min.push_back(stats.min);
+      res.max.push_back(stats.max);
+      res.mean.push_back(stats.mean);
+    }
+    auto swarmStats = TelemetryStore::stats(allValues);
+    res.swarmMin = swarmStats.min;
+    res.swarmMax = swarmStats.max;
+    res.swarmMean = swarmStats.mean;
+
+    return true;
+  }
+  // Sets the given parameters (<group>/<name>, values from /allcfs/<group>/<name>)
+  // on all CFs (see CrazyflieGroup::setParams).
   bool updateParams(
     crazyflie_driver::UpdateParams::Request& req,
     crazyflie_driver::UpdateParams::Response& res)
   {
     ROS_INFO("UpdateParams!");
 
-    for (size_t i = 0; i < m_broadcastingNumRepeats; ++i) {
-      for (auto& group : m_groups) {
-        group->updateParams(req.group, req.params);
+    XmlRpc::XmlRpcValue params;
+    for (const auto& p : req.params) {
+      size_t pos = p.find("/");
+      XmlRpc::XmlRpcValue value;
+      if (pos == std::string::npos || !ros::param::get("/allcfs/" + p, value)) {
+        ROS_ERROR("Could not read param /allcfs/%s", p.c_str());
+        continue;
       }
-      std::this_thread::sleep_for(std::chrono::milliseconds(m_broadcastingDelayBetweenRepeatsMs));
+      std::string group(p.begin(), p.begin() + pos);
+      std::string name(p.begin() + pos + 1, p.end());
+      params[group][name] = value;
+    }
+    if (!params.valid()) {
+      return true;
     }
 
+    // on the slow threads, since CFs can be added or removed meanwhile
+    parallelFor(m_groups.size(), m_groups.size(), [&](size_t i) {
+      CrazyflieGroup* group = m_groups[i];
+      if (!group->runOnSlowThread([&] { group->setParams(params); return true; })) {
+        ROS_ERROR("[radio %d] Could not set parameters (stopped)", group->radio());
+      }
+    });
+
     return true;
   }
-#endif
-//
-  void readMarkerConfigurations(
-    std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations)
+
+  bool addCrazyflie(
+    crazyswarm::AddCrazyflie::Request& req,
+    crazyswarm::AddCrazyflie::Response& res)
   {
-    markerConfigurations.clear();
-    ros::NodeHandle nGlobal;
-    int numConfigurations;
-    nGlobal.getParam("numMarkerConfigurations", numConfigurations);
-    for (int i = 0; i < numConfigurations; ++i) {
-      markerConfigurations.push_back(pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>));
-      std::stringstream sstr;
-      sstr << "markerConfigurations/" << i << "/numPoints";
-      int numPoints;
-      nGlobal.getParam(sstr.str(), numPoints);
+    ROS_INFO("AddCrazyflie cf%d!", req.id);
 
-      std::vector<double> offset;
-      std::stringstream sstr2;
-      sstr2 << "markerConfigurations/" << i << "/offset";
-      nGlobal.getParam(sstr2.str(), offset);
-      for (int j = 0; j < numPoints; ++j) {
-        std::stringstream sstr3;
-        sstr3 << "markerConfigurations/" << i << "/points/" << j;
-        std::vector<double> points;
-        nGlobal.getParam(sstr3.str(), points);
-        markerConfigurations.back()->push_back(pcl::PointXYZ(points[0] + offset[0], points[1] + offset[1], points[2] + offset[2]));
+    if (groupOf(req.id)) {
+      res.message = "cf" + std::to_string(req.id) + " is already part of the swarm";
+      return true;
+    }
+    CrazyflieGroup* group = nullptr;
+    for (auto g : m_groups) {
+      if (g->channel() == req.channel) {
+        group = g;
       }
     }
+    if (!group) {
+      res.message = "No radio on channel " + std::to_string(req.channel);
+      return true;
+    }
+
+    SwarmConfig::CrazyflieConfig config{req.id, req.channel, req.type,
+      {req.initialPosition[0], req.initialPosition[1], req.initialPosition[2]}};
+    std::string message;
+    res.success = group->runOnSlowThread([&] { return group->changeCrazyflies(-1, &config, message); });
+    res.message = message;
+    return true;
   }
 
-  void readDynamicsConfigurations(
-    std::vector<libobjecttracker::DynamicsConfiguration>& dynamicsConfigurations)
+  bool removeCrazyflie(
+    crazyswarm::RemoveCrazyflie::Request& req,
+    crazyswarm::RemoveCrazyflie::Response& res)
   {
-    ros::NodeHandle nGlobal;
-    int numConfigurations;
-    nGlobal.getParam("numDynamicsConfigurations", numConfigurations);
-    dynamicsConfigurations.resize(numConfigurations);
-    for (int i = 0; i < numConfigurations; ++i) {
-      std::stringstream sstr;
-      sstr << "dynamicsConfigurations/" << i;
-      nGlobal.getParam(sstr.str() + "/maxXVelocity", dynamicsConfigurations[i].maxXVelocity);
-      nGlobal.getParam(sstr.str() + "/maxYVelocity", dynamicsConfigurations[i].maxYVelocity);
-      nGlobal.getParam(sstr.str() + "/maxZVelocity", dynamicsConfigurations[i].maxZVelocity);
-      nGlobal.getParam(sstr.str() + "/maxPitchRate", dynamicsConfigurations[i].maxPitchRate);
-      nGlobal.getParam(sstr.str() + "/maxRollRate", dynamicsConfigurations[i].maxRollRate);
-      nGlobal.getParam(sstr.str() + "/maxYawRate", dynamicsConfigurations[i].maxYawRate);
-      nGlobal.getParam(sstr.str() + "/maxRoll", dynamicsConfigurations[i].maxRoll);
-      nGlobal.getParam(sstr.str() + "/maxPitch", dynamicsConfigurations[i].maxPitch);
-      nGlobal.getParam(sstr.str() + "/maxFitnessScore", dynamicsConfigurations[i].maxFitnessScore);
+    ROS_INFO("RemoveCrazyflie cf%d!", req.id);
+
+    CrazyflieGroup* group = groupOf(req.id);
+    if (!group) {
+      res.message = "cf" + std::to_string(req.id) + " is not part of the swarm";
+      return true;
     }
+
+    std::string message;
+    res.success = group->runOnSlowThread([&] { return group->changeCrazyflies(req.id, nullptr, message); });
+    res.message = message;
+    return true;
   }
 
-  void readChannels(
-    std::set<int>& channels)
+  // The new CF is brought up before the old one is disconnected (unless both
+  // have the same id, i.e., the same radio address and ROS namespace: then the
+  // old one is removed first and stays removed if the new one fails). As for
+  // addCrazyflie, the bring-up blocks the server's service thread (all swarm
+  // services except emergency) until it finished.
+  bool replaceCrazyflie(
+    crazyswarm::ReplaceCrazyflie::Request& req,
+    crazyswarm::ReplaceCrazyflie::Response& res)
   {
-    // read CF config
-    ros::NodeHandle nGlobal;
+    ROS_INFO("ReplaceCrazyflie cf%d by cf%d!", req.id, req.newId);
+
+    CrazyflieGroup* group = groupOf(req.id);
+    if (!group) {
+      res.message = "cf" + std::to_string(req.id) + " is not part of the swarm";
+      return true;
+    }
+    if (req.newId != req.id && groupOf(req.newId)) {
+      res.message = "cf" + std::to_string(req.newId) + " is already part of the swarm";
+      return true;
+    }
+
+    SwarmConfig::CrazyflieConfig config{req.newId, group->channel(), req.type,
+      {req.initialPosition[0], req.initialPosition[1], req.initialPosition[2]}};
+    std::string message;
+    if (req.newId == req.id) {
+      if (config.type.empty()) {
+        config.type = group->typeOf(req.id);
+      }
+      bool removed = false;
+      res.success = group->runOnSlowThread([&] {
+        removed = group->changeCrazyflies(req.id, nullptr, message);
+        return removed && group->changeCrazyflies(-1, &config, message); });
+      if (removed && !res.success) {
+        message = "cf" + std::to_string(req.id) + " was removed, but could not be brought up again: " + message;
+      }
+    } else {
+      res.success = group->runOnSlowThread([&] { return group->changeCrazyflies(req.id, &config, message); });
+    }
+    res.message = message;
+    return true;
+  }
+
+  // Uploads a trajectory to many CFs: all radios in parallel, skipping CFs that
+  // already have it (unless req.force). With req.broadcast, each radio writes the trajectory once for
+  // all its CFs (e.g., a formation flying the same trajectory relative to each
+  // CF's start position).
+  bool uploadTrajectory(
+    crazyswarm::UploadSwarmTrajectory::Request& req,
+    crazyswarm::UploadSwarmTrajectory::Response& res)
+  {
+    ROS_INFO("UploadTrajectory!");
+
+    std::vector<Crazyflie::poly4d> pieces;
+    if (!toPoly4d(req.pieces, pieces)) {
+      ROS_FATAL("Wrong number of pieces!");
+      return false;
+    }
+    std::set<int> ids(req.ids.begin(), req.ids.end());
+
+    // with a timescale, only upload feasible trajectories; startTrajectory checks
+    // the timescale in any case
+    if (req.timescale > 0 && !m_feasibility.empty()) {
+      auto start = std::chrono::high_resolution_clock::now();
+      FeasibilityResult worst = m_feasibility.check(pieces, req.timescale);
+      std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+      res.minTimescale = worst.minTimescale;
+      if (!worst.feasible()) {
+        res.violation = worst.describe();
+        ROS_ERROR("Trajectory %d is not feasible with timescale %f: %s (checked in %f s)",
+          req.trajectoryId, req.timescale, res.violation.c_str(), elapsed.count());
+        return true;
+      }
+      ROS_INFO("Trajectory %d is feasible with timescale %f (fastest feasible timescale %f, checked in %f s)",
+        req.trajectoryId, req.timescale, res.minTimescale, elapsed.count());
+    }
+
+    if (m_trajectoryMaxError > 0) {
+      reportEncoding(req.trajectoryId, pieces);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<crazyswarm::UploadSwarmTrajectory::Response> results(m_groups.size());
+    parallelFor(m_groups.size(), m_groups.size(), [&](size_t i) {
+      CrazyflieGroup* group = m_groups[i];
+      bool ran = group->runOnSlowThread([&] {
+        if (req.broadcast) {
+          group->broadcastTrajectory(ids, req.groupMask, req.trajectoryId, req.pieceOffset, pieces,
+            m_trajectoryBroadcastRepeats, std::chrono::microseconds(m_trajectoryBroadcastPacketDelayUs),
+            m_broadcastingConfidence, m_trajectoryChecksumVariable, req.force, results[i]);
+        } else {
+          group->uploadTrajectory(ids, req.groupMask, req.trajectoryId, req.pieceOffset, pieces, req.force, results[i]);
+        }
+        return true;
+      });
+      if (!ran) {
+        results[i].failedIds = group->selectedIds(ids, req.groupMask);
+      }
+    });
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    for (const auto& result : results) {
+      res.uploadedIds.insert(res.uploadedIds.end(), result.uploadedIds.begin(), result.uploadedIds.end());
+      res.throughput.insert(res.throughput.end(), result.throughput.begin(), result.throughput.end());
+      res.skippedIds.insert(res.skippedIds.end(), result.skippedIds.begin(), result.skippedIds.end());
+      res.failedIds.insert(res.failedIds.end(), result.failedIds.begin(), result.failedIds.end());
+    }
+    double meanThroughput = 0;
+    for (double throughput : res.throughput) {
+      meanThroughput += throughput / res.throughput.size();
+    }
+    ROS_INFO("Uploaded trajectory %d (%lu pieces) to %lu CFs in %f s (%.0f B/s per CF), skipped %lu, failed %lu",
+      req.trajectoryId, pieces.size(), res.uploadedIds.size(), elapsed.count(), meanThroughput,
+      res.skippedIds.size(), res.failedIds.size());
+
+    return true;
+  }
+
+  // Diagnostic (trajectory_encoding_max_error): logs the size of the compact encoding
+  // of a trajectory (see TrajectoryEncoding) after verifying it, once per upload
+  // service call. The firmware only accepts float pieces, so the encoding is not sent.
+  void reportEncoding(
+    uint8_t trajectoryId,
+    const std::vector<Crazyflie::poly4d>& pieces) const
+  {
+    size_t rawBytes = TrajectoryEncoding::rawSize(pieces.size());
+    std::vector<Crazyflie::poly4d> decoded;
+    auto stats = TrajectoryEncoding::check(pieces, m_trajectoryMaxError, decoded);
+    if (decoded.empty()) {
+      ROS_WARN("Trajectory %d: %zu pieces, %zu B (encoding error %g exceeds %g)",
+        trajectoryId, pieces.size(), rawBytes, stats.maxError, m_trajectoryMaxError);
+      return;
+    }
+    ROS_INFO("Trajectory %d: %zu pieces, %zu B (encoded %zu B, %.0f %%, max. error %g)",
+      trajectoryId, pieces.size(), rawBytes, stats.encodedBytes,
+      100.0 * stats.encodedBytes / rawBytes, stats.maxError);
+  }
+
+  // Limits of each dynamics configuration of the swarm; the thrust limit scales with
+  // ctrlNN.max_thrust (global firmwareParams, or per type)
+  void readFeasibilityLimits(
+    ros::NodeHandle& nl)
+  {
+    double thrustToWeight;
+    double maxThrust;
+    nl.param<double>("trajectory_thrust_to_weight", thrustToWeight, 1.9);
+    double sampleTime;
+    nl.param<double>("trajectory_feasibility_sample_time", sampleTime, 0.01);
+    nl.param<double>("firmwareParams/ctrlNN/max_thrust", maxThrust, 1.0);
+
+    m_feasibility.clear();
+    m_feasibility.setSampleTime(sampleTime);
+    if (thrustToWeight <= 0) {
+      return;
+    }
+    for (const auto& type : m_swarmConfig.types) {
+      const SwarmConfig::DynamicsConfiguration& d = m_swarmConfig.dynamicsConfigurations.at(type.second.dynamicsConfiguration);
+      double typeMaxThrust = maxThrust;
+      for (const auto& param : type.second.firmwareParams) {
+        if (param.group == "ctrlNN" && param.name == "max_thrust") {
+          typeMaxThrust = param.value;
+        }
+      }
+      FeasibilityLimits limits;
+      limits.maxVelocityX = d.maxXVelocity;
+      limits.maxVelocityY = d.maxYVelocity;
+      limits.maxVelocityZ = d.maxZVelocity;
+      // conservative: the combined tilt, and the combined roll and pitch rate
+      limits.maxTilt = std::min(d.maxRoll, d.maxPitch);
+      limits.maxBodyRate = std::min(d.maxRollRate, d.maxPitchRate);
+      limits.maxYawRate = d.maxYawRate;
+      limits.maxThrustToWeight = thrustToWeight * typeMaxThrust;
+      m_feasibility.setLimits(type.first, limits);
+    }
+  }
+
+  // Uploads a NN to many CFs: the file is read once, CFs that already have it
+  // (uploaded by this server, same content) are skipped, and all radios upload
+  // in parallel.
+  bool uploadNN(
+    crazyswarm::UploadSwarmNN::Request& req,
+    crazyswarm::UploadSwarmNN::Response& res)
+  {
+    ROS_INFO("UploadNN %s!", req.filename.c_str());
+
+    std::vector<uint8_t> nnDesc;
+    {
+      MappedFile file(req.filename);
+      if (!file.valid()) {
+        res.message = file.error();
+        ROS_ERROR("Could not read NN: %s", res.message.c_str());
+        return true;
+      }
+      // the only copy, shared by all radios (Crazyflie::uploadNN takes a vector)
+      nnDesc.assign(file.begin(), file.end());
+    }
+    uint64_t hash = CrazyflieROS::nnHash(nnDesc);
+    std::set<int> ids(req.ids.begin(), req.ids.end());
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<crazyswarm::UploadSwarmNN::Response> results(m_groups.size());
+    parallelFor(m_groups.size(), m_groups.size(), [&](size_t i) {
+      CrazyflieGroup* group = m_groups[i];
+      bool ran = group->runOnSlowThread([&] {
+        group->uploadNN(ids, req.groupMask, nnDesc, hash, req.force, results[i]);
+        return true;
+      });
+      if (!ran) {
+        results[i].failedIds = group->selectedIds(ids, req.groupMask);
+      }
+    });
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    for (const auto& result : results) {
+      res.uploadedIds.insert(res.uploadedIds.end(), result.uploadedIds.begin(), result.uploadedIds.end());
+      res.throughput.insert(res.throughput.end(), result.throughput.begin(), result.throughput.end());
+      res.skippedIds.insert(res.skippedIds.end(), result.skippedIds.begin(), result.skippedIds.end());
+      res.failedIds.insert(res.failedIds.end(), result.failedIds.begin(), result.failedIds.end());
+    }
+    std::stringstream sstr;
+    sstr << "Uploaded NN (" << CrazyflieROS::describeNN(nnDesc) << ", hash " << std::hex << hash << std::dec << ") to "
+         << res.uploadedIds.size() << " CFs in " << elapsed.count() << " s, skipped "
+         << res.skippedIds.size() << ", failed " << res.failedIds.size();
+    res.message = sstr.str();
+    ROS_INFO("%s", res.message.c_str());
+
+    return true;
+  }
 
-    XmlRpc::XmlRpcValue crazyflies;
-    nGlobal.getParam("crazyflies", crazyflies);
-    ROS_ASSERT(crazyflies.getType() == XmlRpc::XmlRpcValue::TypeArray);
+  // Returns once the first segment is uploaded and started; the CF's group
+  // streams the rest (see TrajectoryStream).
+  bool streamTrajectory(
+    crazyswarm::StreamTrajectory::Request& req,
+    crazyswarm::StreamTrajectory::Response& res)
+  {
+    ROS_INFO("StreamTrajectory cf%d!", req.id);
 
-    channels.clear();
-    for (int32_t i = 0; i < crazyflies.size(); ++i) {
-      ROS_ASSERT(crazyflies[i].getType() == XmlRpc::XmlRpcValue::TypeStruct);
-      XmlRpc::XmlRpcValue crazyflie = crazyflies[i];
-      int channel = crazyflie["channel"];
-      channels.insert(channel);
+    CrazyflieGroup* group = groupOf(req.id);
+    if (!group) {
+      res.message = "cf" + std::to_string(req.id) + " is not part of the swarm";
+      return true;
+    }
+
+    std::vector<Crazyflie::poly4d> pieces;
+    if (!toPoly4d(req.pieces, pieces)) {
+      ROS_FATAL("Wrong number of pieces!");
+      return false;
+    }
+    if (req.relative) {
+      // every segment would be re-anchored at the CF's position at its start
+      res.message = "relative is not supported for streams; use absolute pieces";
+      return true;
+    }
+    TrajectoryStream::Settings settings{req.trajectoryId, req.pieceOffset, req.regionPieces,
+      req.lookahead, req.timescale};
+
+    std::string message;
+    res.success = group->runOnSlowThread([&] { return group->streamTrajectory(req.id, settings, pieces, message); });
+    res.message = message;
+    return true;
+  }
+
+  // Hands a command to all groups with the same start time, so that the radios
+  // send the first copy concurrently, and reports the skew between the radios.
+  void dispatch(
+    const std::string& name,
+    std::function<CrazyflieGroup::CommandSent(CrazyflieGroup*, BroadcastScheduler::clock::time_point)> command)
+  {
+    auto startTime = BroadcastScheduler::clock::now() + std::chrono::microseconds(m_broadcastingDispatchLeadUs);
+    std::vector<CrazyflieGroup::CommandSent> results;
+    for (auto& group : m_groups) {
+      results.push_back(command(group, startTime));
+    }
+
+    std::vector<double> offsets;
+    for (auto& result : results) {
+      try {
+        std::chrono::duration<double, std::milli> offset = result.get() - startTime;
+        offsets.push_back(offset.count());
+      } catch (std::future_error&) {
+        // replaced by a newer command before it was sent, or refused in an emergency
+      }
+    }
+    if (!offsets.empty()) {
+      auto minmax = std::minmax_element(offsets.begin(), offsets.end());
+      ROS_INFO("%s: first copy on %zu radio(s) %.3f..%.3f ms after the start time (skew %.3f ms)",
+        name.c_str(), offsets.size(), *minmax.first, *minmax.second, *minmax.second - *minmax.first);
+    }
+  }
+
+  CrazyflieGroup* groupOf(int id)
+  {
+    for (auto group : m_groups) {
+      if (group->hasCrazyflie(id)) {
+        return group;
+      }
+    }
+    return nullptr;
+  }
+//
+  void convertMarkerConfigurations(
+    std::vector<libobjecttracker::MarkerConfiguration>& markerConfigurations)
+  {
+    markerConfigurations.clear();
+    for (const auto& config : m_swarmConfig.markerConfigurations) {
+      markerConfigurations.push_back(pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>));
+      for (const auto& point : config.points) {
+        markerConfigurations.back()->push_back(pcl::PointXYZ(point[0], point[1], point[2]));
+      }
+    }
+  }
+
+  void convertDynamicsConfigurations(
+    std::vector<libobjecttracker::DynamicsConfiguration>& dynamicsConfigurations)
+  {
+    dynamicsConfigurations.resize(m_swarmConfig.dynamicsConfigurations.size());
+    for (size_t i = 0; i < dynamicsConfigurations.size(); ++i) {
+      const auto& config = m_swarmConfig.dynamicsConfigurations[i];
+      dynamicsConfigurations[i].maxXVelocity = config.maxXVelocity;
+      dynamicsConfigurations[i].maxYVelocity = config.maxYVelocity;
+      dynamicsConfigurations[i].maxZVelocity = config.maxZVelocity;
+      dynamicsConfigurations[i].maxPitchRate = config.maxPitchRate;
+      dynamicsConfigurations[i].maxRollRate = config.maxRollRate;
+      dynamicsConfigurations[i].maxYawRate = config.maxYawRate;
+      dynamicsConfigurations[i].maxRoll = config.maxRoll;
+      dynamicsConfigurations[i].maxPitch = config.maxPitch;
+      dynamicsConfigurations[i].maxFitnessScore = config.maxFitnessScore;
     }
   }
 
 private:
+  const SwarmConfig& m_swarmConfig;
   std::string m_worldFrame;
-  bool m_isEmergency;
+  std::atomic<bool> m_isEmergency;
   ros::ServiceServer m_serviceEmergency;
   ros::ServiceServer m_serviceStartTrajectory;
   ros::ServiceServer m_serviceTakeoff;
@@ -1775,6 +3795,13 @@ private:
   ros::ServiceServer m_serviceStop;
   ros::ServiceServer m_serviceNextPhase;
   ros::ServiceServer m_serviceUpdateParams;
+  ros::ServiceServer m_serviceQueryTelemetry;
+  ros::ServiceServer m_serviceAddCrazyflie;
+  ros::ServiceServer m_serviceRemoveCrazyflie;
+  ros::ServiceServer m_serviceReplaceCrazyflie;
+  ros::ServiceServer m_serviceUploadTrajectory;
+  ros::ServiceServer m_serviceStreamTrajectory;
+  ros::ServiceServer m_serviceUploadNN;
 
   ros::Publisher m_pubPointCloud;
   // tf::TransformBroadcaster m_br;
@@ -1786,6 +3813,18 @@ private:
 
   int m_broadcastingNumRepeats;
   int m_broadcastingDelayBetweenRepeatsMs;
+  int m_broadcastingDispatchLeadUs;
+  double m_broadcastingConfidence;
+  int m_trajectoryBroadcastRepeats;
+  int m_trajectoryBroadcastPacketDelayUs;
+  std::string m_trajectoryChecksumVariable;
+  // > 0: report the size of the compact encoding of uploaded trajectories (see reportEncoding)
+  double m_trajectoryMaxError;
+  FeasibilityChecker m_feasibility;
+
+  std::unique_ptr<TelemetryStore> m_telemetry;
+  std::unique_ptr<TocCache> m_tocCache;
+  StartupTracer m_startupTracer;
 
 private:
   // We have two callback queues
@@ -1793,8 +3832,10 @@ private:
   // 2. Slow queue handles all other requests.
   // Each queue is handled in its own thread. We don't want a thread per CF to make sure that the fast queue
   //  gets called frequently enough.
+  // The emergency service has its own queue and thread (see runEmergency).
 
   ros::CallbackQueue m_queue;
+  ros::CallbackQueue m_emergencyQueue;
   // ros::CallbackQueue m_slowQueue;
 };
 
@@ -1810,29 +3851,27 @@ int main(int argc, char **argv)
   // std::string broadcastUri;
   // n.getParam("broadcast_uri", broadcastUri);
 
-  CrazyflieServer server;//(broadcastUri, worldFrame);
-
-  // read CF config
+  // read the swarm configuration once
+  SwarmConfig swarmConfig;
+  auto start = std::chrono::high_resolution_clock::now();
   ros::NodeHandle nGlobal;
-
-  XmlRpc::XmlRpcValue crazyflies;
-  nGlobal.getParam("crazyflies", crazyflies);
-  ROS_ASSERT(crazyflies.getType() == XmlRpc::XmlRpcValue::TypeArray);
+  swarmConfig.readFromParameterServer(nGlobal);
+  std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+  ROS_INFO("Swarm configuration: %zu CFs, %zu types (%f s)",
+    swarmConfig.crazyflies.size(), swarmConfig.types.size(), elapsed.count());
 
   std::set<int> cfIds;
-  for (int32_t i = 0; i < crazyflies.size(); ++i)
+  for (const auto& crazyflie : swarmConfig.crazyflies)
   {
-    ROS_ASSERT(crazyflies[i].getType() == XmlRpc::XmlRpcValue::TypeStruct);
-    XmlRpc::XmlRpcValue crazyflie = crazyflies[i];
-    int id = crazyflie["id"];
-    int channel = crazyflie["channel"];
-    if (cfIds.find(id) != cfIds.end()) {
+    if (cfIds.find(crazyflie.id) != cfIds.end()) {
       ROS_FATAL("CF with the same id twice in configuration!");
       return 1;
     }
-    cfIds.insert(id);
+    cfIds.insert(crazyflie.id);
   }
 
+  CrazyflieServer server(swarmConfig);//(broadcastUri, worldFrame);
+
   // ROS_INFO("All CFs are ready!");
 
   server.run();
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+Log bandwidth planning for one radio (== one CrazyflieGroup)
+ * Log data is returned in the ACKs of unicast packets (pings), one log packet per ACK.
+   Each log block sample therefore costs one radio transaction per CF.
+ * The pose broadcast uses ceil(N / posesPerPacket) packets per motion capture frame.
+ * The remaining packet budget of the radio is shared by the log blocks of all CFs.
+   If the requested rates do not fit, all blocks are scaled down by the same factor.
+ * Log periods on the CF are in units of 10 ms; pings are sent from the group's slow
+   thread, which ticks every 10 ms.
+*/
+
+class LogBandwidthPlanner
+{
+public:
+  // maximum log payload of a single CRTP log packet (30 bytes - block id - timestamp)
+  static constexpr size_t MaxBlockSize = 26;
+  // tick of the ping timer (runs on the group's slow thread)
+  static constexpr double TickRate = 100.0;
+  // minimum ping rate per CF, even if no log data is requested (console output)
+  static constexpr double MinPingRate = 10.0;
+
+  struct Block
+  {
+    std::string name;
+    double requestedFrequency; // Hz
+    double frequency;          // Hz, as planned
+    uint8_t period;            // in 10 ms
+  };
+
+  struct Plan
+  {
+    std::vector<Block> blocks;
+    size_t numCFs;
+    double budget;             // packets/s available for logging
+    double posePackets;        // packets/s used by the pose broadcast
+    double logPackets;         // packets/s used by logging (planned)
+    double pingRate;           // pings/s per CF
+    int pingPeriodTicks;       // ping every n-th tick of the ping timer
+  };
+
+  LogBandwidthPlanner(
+    double radioPacketsPerSecond,
+    double motionCaptureFrequency,
+    size_t posesPerPacket)
+    : m_radioPacketsPerSecond(radioPacketsPerSecond)
+    , m_motionCaptureFrequency(motionCaptureFrequency)
+    , m_posesPerPacket(std::max<size_t>(posesPerPacket, 1))
+  {
+  }
+
+  Plan plan(
+    size_t numCFs,
+    const std::vector<std::pair<std::string, double> >& requested) const
+  {
+    Plan result;
+    result.numCFs = numCFs;
+    result.posePackets = m_motionCaptureFrequency * std::ceil(numCFs / (double)m_posesPerPacket);
+    result.budget = std::max(m_radioPacketsPerSecond - result.posePackets, 0.0);
+
+    double requestedPerCF = 0;
+    for (const auto& r : requested) {
+      requestedPerCF += std::max(r.second, 0.0);
+    }
+
+    // common scale factor such that all blocks of all CFs fit into the budget
+    // and each CF can be pinged often enough by the slow thread
+    double scale = 1.0;
+    if (requestedPerCF > 0 && numCFs > 0) {
+      scale = std::min(scale, result.budget / (requestedPerCF * numCFs));
+      scale = std::min(scale, TickRate / requestedPerCF);
+    }
+
+    double planned = 0;
+    for (const auto& r : requested) {
+      Block b;
+      b.name = r.first;
+      b.requestedFrequency = r.second;
+      double f = std::max(r.second, 0.0) * scale;
+      if (f <= 0) {
+        b.period = 255;
+      } else {
+        // round period up, so we never exceed the scaled rate
+        b.period = (uint8_t)std::min(std::max(std::ceil(TickRate / f), 1.0), 255.0);
+      }
+      b.frequency = TickRate / b.period;
+      planned += b.frequency;
+      result.blocks.push_back(b);
+    }
+
+    result.logPackets = planned * numCFs;
+    result.pingRate = std::max(planned, (double)MinPingRate);
+    result.pingPeriodTicks = std::max((int)std::floor(TickRate / result.pingRate), 1);
+    return result;
+  }
+
+  static std::string summary(const Plan& plan)
+  {
+    std::stringstream sstr;
+    sstr << "Log bandwidth plan for " << plan.numCFs << " CFs: "
+         << plan.logPackets << " of " << plan.budget << " packets/s"
+         << " (pose broadcast: " << plan.posePackets << " packets/s)"
+         << ", ping every " << plan.pingPeriodTicks * 10 << " ms" << std::endl;
+    for (const auto& b : plan.blocks) {
+      sstr << "  " << b.name << ": requested " << b.requestedFrequency << " Hz"
+           << ", planned " << b.frequency << " Hz (period " << (int)b.period * 10 << " ms)" << std::endl;
+    }
+    return sstr.str();
+  }
+
+private:
+  double m_radioPacketsPerSecond;
+  double m_motionCaptureFrequency;
+  size_t m_posesPerPacket;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+Read-only memory mapping of a file (e.g., a NN descriptor that is uploaded to many CFs)
+ * The file is read by the kernel on demand instead of being copied into a buffer per upload.
+ * error() describes why the mapping failed (valid() is false).
+*/
+
+class MappedFile
+{
+public:
+  MappedFile(
+    const std::string& fileName)
+    : m_data(nullptr)
+    , m_size(0)
+    , m_error()
+  {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      m_error = fileName + ": " + std::strerror(errno);
+      return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      m_error = fileName + ": " + std::strerror(errno);
+    } else if (st.st_size == 0) {
+      m_error = fileName + ": empty file";
+    } else {
+      void* data = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        m_error = fileName + ": " + std::strerror(errno);
+      } else {
+        m_data = static_cast<const uint8_t*>(data);
+        m_size = st.st_size;
+      }
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile()
+  {
+    if (m_data) {
+      ::munmap(const_cast<uint8_t*>(m_data), m_size);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool valid() const {
+    return m_data != nullptr;
+  }
+
+  const std::string& error() const {
+    return m_error;
+  }
+
+  const uint8_t* data() const {
+    return m_data;
+  }
+
+  size_t size() const {
+    return m_size;
+  }
+
+  const uint8_t* begin() const {
+    return m_data;
+  }
+
+  const uint8_t* end() const {
+    return m_data + m_size;
+  }
+
+private:
+  const uint8_t* m_data;
+  size_t m_size;
+  std::string m_error;
+};
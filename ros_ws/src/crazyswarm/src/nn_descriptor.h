@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+NN descriptor (the blob sent by uploadNN), as written by scripts/nnQuantize.py
+ * A fully connected network: hidden layers use the given activation, the output layer is linear.
+ * Weights are float32, float16, or int8 with a per-layer scale (w = q * scale); biases are always
+   float32. int8 weights are a quarter of the float32 upload and on-board memory.
+ * Layout (little endian):
+     char magic[4] = "CFNN", uint8 version = 1, uint8 dtype, uint8 numLayers, uint8 activation
+     per layer: uint16 inputs, uint16 outputs, float32 scale,
+                weights (outputs x inputs, row major, padded to 4 bytes), float32 bias[outputs]
+ * Blobs without the magic are older (opaque) descriptors; parse() rejects them.
+ * Only a firmware that reports the highest version it decodes in the parameter ctrlNN.cfnnVersion
+   accepts CFNN descriptors; the server refuses to upload them to any other CF.
+*/
+
+class NNDescriptor
+{
+public:
+  enum DType {
+    Float32 = 0,
+    Float16 = 1,
+    Int8 = 2,
+  };
+
+  enum Activation {
+    ReLU = 0,
+    Tanh = 1,
+  };
+
+  struct Layer
+  {
+    size_t inputs;
+    size_t outputs;
+    float scale;
+    std::vector<float> weights;  // dequantized, outputs x inputs
+    std::vector<float> bias;
+  };
+
+  NNDescriptor()
+    : m_dtype(Float32)
+    , m_activation(ReLU)
+    , m_layers()
+    , m_size(0)
+  {
+  }
+
+  // Version of a CFNN descriptor, 0 for an opaque descriptor
+  static int version(
+    const uint8_t* data,
+    size_t size)
+  {
+    if (size < 8 || std::memcmp(data, "CFNN", 4) != 0) {
+      return 0;
+    }
+    return data[4];
+  }
+
+  // Returns false (with a message) if the data is not a valid descriptor
+  bool parse(
+    const uint8_t* data,
+    size_t size,
+    std::string& message)
+  {
+    m_layers.clear();
+    m_size = size;
+    size_t pos = 0;
+    if (size < 8 || std::memcmp(data, "CFNN", 4) != 0) {
+      message = "not a CFNN descriptor";
+      return false;
+    }
+    if (data[4] != 1) {
+      message = "unsupported version " + std::to_string(data[4]);
+      return false;
+    }
+    if (data[5] > Int8 || data[7] > Tanh) {
+      message = "unknown weight type or activation";
+      return false;
+    }
+    m_dtype = (DType)data[5];
+    size_t numLayers = data[6];
+    m_activation = (Activation)data[7];
+    pos = 8;
+
+    for (size_t l = 0; l < numLayers; ++l) {
+      Layer layer;
+      uint16_t inputs;
+      uint16_t outputs;
+      if (!read(data, size, pos, inputs) || !read(data, size, pos, outputs) || !read(data, size, pos, layer.scale)) {
+        message = "truncated layer header";
+        return false;
+      }
+      layer.inputs = inputs;
+      layer.outputs = outputs;
+      if (!m_layers.empty() && m_layers.back().outputs != layer.inputs) {
+        message = "layer " + std::to_string(l) + " does not match the previous layer";
+        return false;
+      }
+
+      size_t n = layer.inputs * layer.outputs;
+      size_t bytes = n * elementSize(m_dtype);
+      if (pos + bytes > size) {
+        message = "truncated weights";
+        return false;
+      }
+      layer.weights.resize(n);
+      for (size_t i = 0; i < n; ++i) {
+        layer.weights[i] = weight(data + pos, i, layer.scale);
+      }
+      pos += (bytes + 3) & ~(size_t)3;
+
+      layer.bias.resize(layer.outputs);
+      for (size_t i = 0; i < layer.outputs; ++i) {
+        if (!read(data, size, pos, layer.bias[i])) {
+          message = "truncated bias";
+          return false;
+        }
+      }
+      m_layers.push_back(layer);
+    }
+    if (m_layers.empty()) {
+      message = "no layers";
+      return false;
+    }
+    return true;
+  }
+
+  DType dtype() const {
+    return m_dtype;
+  }
+
+  Activation activation() const {
+    return m_activation;
+  }
+
+  const std::vector<Layer>& layers() const {
+    return m_layers;
+  }
+
+  size_t inputs() const {
+    return m_layers.front().inputs;
+  }
+
+  size_t outputs() const {
+    return m_layers.back().outputs;
+  }
+
+  // Size of the same network with float32 weights
+  size_t float32Size() const
+  {
+    size_t size = 8;
+    for (const auto& layer : m_layers) {
+      size += 8 + 4 * (layer.inputs * layer.outputs + layer.outputs);
+    }
+    return size;
+  }
+
+  // e.g., "18-64-64-4, int8, relu, 4.9 kB (float32: 18.2 kB)"
+  std::string summary() const
+  {
+    std::stringstream sstr;
+    sstr << inputs();
+    for (const auto& layer : m_layers) {
+      sstr << "-" << layer.outputs;
+    }
+    static const char* dtypes[] = {"float32", "float16", "int8"};
+    static const char* activations[] = {"relu", "tanh"};
+    sstr << ", " << dtypes[m_dtype] << ", " << activations[m_activation]
+         << ", " << m_size / 1000.0 << " kB (float32: " << float32Size() / 1000.0 << " kB)";
+    return sstr.str();
+  }
+
+  static size_t elementSize(DType dtype)
+  {
+    switch (dtype) {
+      case Float16: return 2;
+      case Int8: return 1;
+      default: return 4;
+    }
+  }
+
+  static float halfToFloat(uint16_t h)
+  {
+    int exponent = (h >> 10) & 0x1f;
+    int mantissa = h & 0x3ff;
+    float value;
+    if (exponent == 0) {
+      value = std::ldexp((float)mantissa, -24);
+    } else if (exponent == 31) {
+      value = mantissa ? NAN : INFINITY;
+    } else {
+      value = std::ldexp((float)(mantissa | 0x400), exponent - 25);
+    }
+    return (h & 0x8000) ? -value : value;
+  }
+
+private:
+  float weight(const uint8_t* data, size_t i, float scale) const
+  {
+    switch (m_dtype) {
+      case Float16: {
+        uint16_t h;
+        std::memcpy(&h, data + 2 * i, 2);
+        return halfToFloat(h);
+      }
+      case Int8:
+        return (int8_t)data[i] * scale;
+      default: {
+        float f;
+        std::memcpy(&f, data + 4 * i, 4);
+        return f;
+      }
+    }
+  }
+
+  template<class T>
+  static bool read(const uint8_t* data, size_t size, size_t& pos, T& value)
+  {
+    if (pos + sizeof(T) > size) {
+      return false;
+    }
+    std::memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+
+  DType m_dtype;
+  Activation m_activation;
+  std::vector<Layer> m_layers;
+  size_t m_size;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Thread helpers of the server (bring-up, one thread per radio) and the batch computations
+(piecewise_batch.h, collision_checker.h, trajectory_feasibility.h, nn_inference.h, swarm_sim.h)
+ * parallelFor runs f(0), ..., f(n-1) using up to concurrency threads (the calling thread is one
+   of them). Indices are handed out one at a time, so slow items (e.g., a CF with a bad link) do
+   not hold up the others.
+ * After the first exception, no further indices are handed out; the calls that already started
+   finish. The first exception is re-thrown in the calling thread once all threads are done.
+ * The batch computations split their work into numThreads shares (see threadCount) and run one
+   share per index of parallelFor(numThreads, numThreads, ...); with one share, no thread is
+   started.
+*/
+
+inline void parallelFor(size_t n, size_t concurrency, std::function<void(size_t)> f)
+{
+  std::atomic<size_t> next(0);
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+  std::mutex errorMutex;
+  auto worker = [&]() {
+    for (size_t i = next++; i < n && !failed; i = next++) {
+      try {
+        f(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    }
+  };
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < std::min(std::max<size_t>(concurrency, 1), n); ++t) {
+    threads.push_back(std::thread(worker));
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// numThreads = 0: all cores; at most maxThreads (e.g., the number of work items), at least 1
+inline size_t threadCount(size_t numThreads, size_t maxThreads)
+{
+  if (numThreads == 0) {
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  return std::max<size_t>(std::min(numThreads, maxThreads), 1);
+}
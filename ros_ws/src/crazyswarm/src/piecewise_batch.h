@@ -0,0 +1,271 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel_for.h"
+
+/*
+Batched evaluation of piecewise polynomial trajectories (poly4d pieces, as uploaded to the CFs)
+ * Evaluates many trajectories at many times with derivatives up to snap, e.g., to simulate,
+   visualize, or check the trajectories of a swarm.
+ * Times are relative to the start of each trajectory and stretched by its timescale. Before the
+   start and after the end, the first and last position is held (zero derivatives).
+ * The piece of each time is found with a cursor (increasing times) or by binary search. Each run
+   of times in the same piece is evaluated with Horner's method over the times, with the
+   coefficients of all derivatives precomputed, so that the inner loop vectorizes (build with -O3
+   -march=native). Blocks of times are spread over threads (see parallel_for.h).
+ * The output is trajectory x derivative x axis (x, y, z, yaw) x time, i.e., contiguous over time.
+*/
+
+class PiecewiseBatch
+{
+public:
+  static constexpr size_t NumAxes = 4;
+  static constexpr size_t NumCoefficients = 8;
+  static constexpr size_t MaxDerivative = 4;    // snap
+  static constexpr size_t PieceSize = 1 + NumAxes * NumCoefficients;  // duration, x, y, z, yaw
+  static constexpr size_t BlockSize = 1024;     // times per work item
+
+  size_t size() const {
+    return m_trajectories.size();
+  }
+
+  void clear() {
+    m_trajectories.clear();
+  }
+
+  // Poly: duration and p[axis][coefficient], e.g., Crazyflie::poly4d
+  template<class Poly>
+  size_t add(
+    const std::vector<Poly>& pieces,
+    float timescale = 1.0,
+    float shiftX = 0,
+    float shiftY = 0,
+    float shiftZ = 0)
+  {
+    std::vector<float> data(pieces.size() * PieceSize);
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      float* piece = &data[i * PieceSize];
+      piece[0] = pieces[i].duration;
+      for (size_t axis = 0; axis < NumAxes; ++axis) {
+        for (size_t coef = 0; coef < NumCoefficients; ++coef) {
+          piece[1 + axis * NumCoefficients + coef] = pieces[i].p[axis][coef];
+        }
+      }
+    }
+    return add(data.data(), data.size(), timescale, shiftX, shiftY, shiftZ);
+  }
+
+  // pieces: n x PieceSize (duration, coefficients of x, y, z, yaw), like the trajectory csv files
+  size_t add(
+    const float* pieces,
+    size_t size,
+    float timescale = 1.0,
+    float shiftX = 0,
+    float shiftY = 0,
+    float shiftZ = 0)
+  {
+    if (size == 0 || size % PieceSize != 0) {
+      throw std::runtime_error("pieces have to be n x " + std::to_string(PieceSize) + " with n > 0");
+    }
+    if (!(timescale > 0)) {
+      throw std::runtime_error("timescale has to be positive");
+    }
+    Trajectory trajectory;
+    trajectory.timescale = timescale;
+    trajectory.shift[0] = shiftX;
+    trajectory.shift[1] = shiftY;
+    trajectory.shift[2] = shiftZ;
+    size_t numPieces = size / PieceSize;
+    trajectory.starts.resize(numPieces + 1);
+    trajectory.coefficients.resize(numPieces * CoefficientsPerPiece);
+    trajectory.starts[0] = 0;
+    for (size_t i = 0; i < numPieces; ++i) {
+      const float* piece = pieces + i * PieceSize;
+      trajectory.starts[i + 1] = trajectory.starts[i] + piece[0];
+      for (size_t d = 0; d <= MaxDerivative; ++d) {
+        for (size_t axis = 0; axis < NumAxes; ++axis) {
+          // d-th derivative: c_k * k! / (k - d)! for t^(k - d)
+          float* c = &trajectory.coefficients[i * CoefficientsPerPiece + (d * NumAxes + axis) * NumCoefficients];
+          for (size_t k = d; k < NumCoefficients; ++k) {
+            float factor = 1;
+            for (size_t j = 0; j < d; ++j) {
+              factor *= k - j;
+            }
+            c[k - d] = piece[1 + axis * NumCoefficients + k] * factor;
+          }
+        }
+      }
+    }
+    m_trajectories.push_back(trajectory);
+    return m_trajectories.size() - 1;
+  }
+
+  // Including the timescale
+  float duration(size_t index) const
+  {
+    const Trajectory& trajectory = m_trajectories.at(index);
+    return trajectory.starts.back() * trajectory.timescale;
+  }
+
+  float timescale(size_t index) const {
+    return m_trajectories.at(index).timescale;
+  }
+
+  // output: size() x (derivatives + 1) x NumAxes x numTimes; numThreads = 0: all cores
+  void evaluate(
+    const float* times,
+    size_t numTimes,
+    size_t derivatives,
+    float* output,
+    size_t outputSize,
+    size_t numThreads = 1) const
+  {
+    if (derivatives > MaxDerivative) {
+      throw std::runtime_error("at most " + std::to_string(MaxDerivative) + " derivatives");
+    }
+    if (outputSize != outputSizeFor(numTimes, derivatives)) {
+      throw std::runtime_error("output has to be " + std::to_string(m_trajectories.size()) + " x "
+        + std::to_string(derivatives + 1) + " x " + std::to_string(NumAxes) + " x " + std::to_string(numTimes));
+    }
+    size_t numBlocks = (numTimes + BlockSize - 1) / BlockSize;
+    size_t numItems = m_trajectories.size() * numBlocks;
+    numThreads = threadCount(numThreads, numItems);
+
+    auto work = [&](size_t thread) {
+      for (size_t item = thread; item < numItems; item += numThreads) {
+        size_t index = item / numBlocks;
+        size_t first = (item % numBlocks) * BlockSize;
+        size_t n = numTimes - first < BlockSize ? numTimes - first : BlockSize;
+        evaluateBlock(index, times + first, n, derivatives,
+          output + index * (derivatives + 1) * NumAxes * numTimes + first, numTimes);
+      }
+    };
+    parallelFor(numThreads, numThreads, work);
+  }
+
+  size_t outputSizeFor(size_t numTimes, size_t derivatives) const {
+    return m_trajectories.size() * (derivatives + 1) * NumAxes * numTimes;
+  }
+
+  // One trajectory at n <= BlockSize times, on the calling thread
+  // output: (derivatives + 1) x NumAxes x stride, i.e., element [d][axis][s] at (d * NumAxes + axis) * stride + s
+  void evaluateBlock(
+    size_t index,
+    const float* times,
+    size_t n,
+    size_t derivatives,
+    float* output,
+    size_t stride) const
+  {
+    size_t pieces[BlockSize];
+    float taus[BlockSize];
+    char holds[BlockSize];
+    evaluateBlock(m_trajectories[index], times, n, derivatives, output, stride, pieces, taus, holds);
+  }
+
+private:
+  static constexpr size_t CoefficientsPerPiece = (MaxDerivative + 1) * NumAxes * NumCoefficients;
+
+  struct Trajectory
+  {
+    float timescale;
+    float shift[3];
+    std::vector<float> starts;        // numPieces + 1, without timescale
+    std::vector<float> coefficients;  // piece x derivative x axis x coefficient
+  };
+
+  // output: derivative x axis x stride, starting at the first time of the block
+  static void evaluateBlock(
+    const Trajectory& trajectory,
+    const float* times,
+    size_t n,
+    size_t derivatives,
+    float* output,
+    size_t stride,
+    size_t* pieces,
+    float* taus,
+    char* holds)
+  {
+    const std::vector<float>& starts = trajectory.starts;
+    const size_t numPieces = starts.size() - 1;
+    const float end = starts.back();
+
+    // piece and local time of each time
+    size_t cursor = 0;
+    for (size_t s = 0; s < n; ++s) {
+      float t = times[s] / trajectory.timescale;
+      holds[s] = !(t >= 0 && t <= end);
+      if (!(t >= 0)) {
+        pieces[s] = 0;
+        taus[s] = 0;
+        continue;
+      }
+      if (t >= end) {
+        pieces[s] = numPieces - 1;
+        taus[s] = starts[numPieces] - starts[numPieces - 1];
+        continue;
+      }
+      if (t < starts[cursor] || t >= starts[cursor + 1]) {
+        if (cursor + 2 <= numPieces && t >= starts[cursor + 1] && t < starts[cursor + 2]) {
+          ++cursor;
+        } else {
+          cursor = std::upper_bound(starts.begin() + 1, starts.end() - 1, t) - (starts.begin() + 1);
+        }
+      }
+      pieces[s] = cursor;
+      taus[s] = t - starts[cursor];
+    }
+
+    // Horner over runs of times in the same piece
+    for (size_t first = 0; first < n;) {
+      size_t last = first + 1;
+      while (last < n && pieces[last] == pieces[first]) {
+        ++last;
+      }
+      const float* coefficients = &trajectory.coefficients[pieces[first] * CoefficientsPerPiece];
+      for (size_t d = 0; d <= derivatives; ++d) {
+        const int degree = NumCoefficients - 1 - d;
+        for (size_t axis = 0; axis < NumAxes; ++axis) {
+          const float* c = coefficients + (d * NumAxes + axis) * NumCoefficients;
+          float* y = output + (d * NumAxes + axis) * stride;
+          for (size_t s = first; s < last; ++s) {
+            y[s] = c[degree];
+          }
+          for (int k = degree - 1; k >= 0; --k) {
+            const float ck = c[k];
+            for (size_t s = first; s < last; ++s) {
+              y[s] = y[s] * taus[s] + ck;
+            }
+          }
+        }
+      }
+      first = last;
+    }
+
+    // shift, timescale, and holds
+    for (size_t axis = 0; axis < 3; ++axis) {
+      float* y = output + axis * stride;
+      const float shift = trajectory.shift[axis];
+      for (size_t s = 0; s < n; ++s) {
+        y[s] += shift;
+      }
+    }
+    float scale = 1;
+    for (size_t d = 1; d <= derivatives; ++d) {
+      scale /= trajectory.timescale;
+      for (size_t axis = 0; axis < NumAxes; ++axis) {
+        float* y = output + (d * NumAxes + axis) * stride;
+        for (size_t s = 0; s < n; ++s) {
+          y[s] = holds[s] ? 0.0f : y[s] * scale;
+        }
+      }
+    }
+  }
+
+  std::vector<Trajectory> m_trajectories;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+Startup tracer
+ * Records the start and end of every bring-up phase (syson, TOCs, log blocks, parameters, ...)
+   of every CF, together with a few numbers that explain its duration (e.g., TOC size,
+   number of parameters, link quality).
+ * Exports the events as Chrome trace JSON (chrome://tracing, ui.perfetto.dev); each radio is
+   shown as a process, each CF as a thread.
+ * summary() lists the phases (total/mean/max over all CFs) and the slowest CFs.
+*/
+
+class StartupTracer
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+private:
+  struct Event
+  {
+    int radio;
+    std::string track;
+    std::string name;
+    clock::time_point start;
+    clock::time_point end;
+    std::vector<std::pair<std::string, double> > args;
+  };
+
+public:
+  // A phase in progress; the event is recorded when the scope ends
+  class Scope
+  {
+  public:
+    Scope(
+      StartupTracer* tracer,
+      int radio,
+      const std::string& track,
+      const std::string& name)
+      : m_tracer(tracer)
+      , m_event()
+    {
+      m_event.radio = radio;
+      m_event.track = track;
+      m_event.name = name;
+      m_event.start = clock::now();
+    }
+
+    Scope(Scope&& other)
+      : m_tracer(other.m_tracer)
+      , m_event(std::move(other.m_event))
+    {
+      other.m_tracer = nullptr;
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope()
+    {
+      end();
+    }
+
+    void arg(const std::string& name, double value)
+    {
+      m_event.args.push_back(std::make_pair(name, value));
+    }
+
+    void end()
+    {
+      if (m_tracer) {
+        m_event.end = clock::now();
+        m_tracer->record(m_event);
+        m_tracer = nullptr;
+      }
+    }
+
+  private:
+    StartupTracer* m_tracer;
+    Event m_event;
+  };
+
+  // All phases of one CF (or of the radio itself)
+  class Track
+  {
+  public:
+    Track(
+      StartupTracer* tracer,
+      int radio,
+      const std::string& name)
+      : m_tracer(tracer)
+      , m_radio(radio)
+      , m_name(name)
+    {
+    }
+
+    Scope scope(const std::string& phase) const
+    {
+      return Scope(m_tracer, m_radio, m_name, phase);
+    }
+
+  private:
+    StartupTracer* m_tracer;
+    int m_radio;
+    std::string m_name;
+  };
+
+  StartupTracer()
+    : m_origin(clock::now())
+  {
+  }
+
+  Track track(int radio, const std::string& name)
+  {
+    return Track(this, radio, name);
+  }
+
+  void writeChromeTrace(const std::string& fileName) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::pair<int, std::string>, int> threadIds;
+    for (const auto& e : m_events) {
+      threadIds.insert(std::make_pair(std::make_pair(e.radio, e.track), threadIds.size() + 1));
+    }
+
+    std::ofstream file(fileName);
+    file << "{\"traceEvents\":[" << std::endl;
+    bool first = true;
+    for (const auto& entry : threadIds) {
+      file << (first ? "" : ",\n")
+           << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << entry.first.first
+           << ",\"args\":{\"name\":\"radio " << entry.first.first << "\"}},\n"
+           << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << entry.first.first
+           << ",\"tid\":" << entry.second
+           << ",\"args\":{\"name\":\"" << entry.first.second << "\"}}";
+      first = false;
+    }
+    for (const auto& e : m_events) {
+      file << (first ? "" : ",\n")
+           << "{\"ph\":\"X\",\"cat\":\"bringup\",\"name\":\"" << e.name << "\""
+           << ",\"pid\":" << e.radio
+           << ",\"tid\":" << threadIds.at(std::make_pair(e.radio, e.track))
+           << ",\"ts\":" << micros(e.start)
+           << ",\"dur\":" << micros(e.end) - micros(e.start)
+           << ",\"args\":{";
+      for (size_t i = 0; i < e.args.size(); ++i) {
+        file << (i == 0 ? "" : ",") << "\"" << e.args[i].first << "\":" << e.args[i].second;
+      }
+      file << "}}";
+      first = false;
+    }
+    file << "\n]}" << std::endl;
+  }
+
+  // Phases over all CFs, and the numSlowest CFs with the longest total bring-up
+  std::string summary(size_t numSlowest) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    struct Phase
+    {
+      double total;
+      double max;
+      size_t count;
+      std::string slowest;
+    };
+    std::vector<std::pair<std::string, Phase> > phases;
+    std::map<std::string, double> cfTotals;
+    std::map<std::string, std::pair<std::string, double> > cfSlowestPhase;
+    for (const auto& e : m_events) {
+      double d = seconds(e);
+      auto iter = std::find_if(phases.begin(), phases.end(),
+        [&](const std::pair<std::string, Phase>& p) { return p.first == e.name; });
+      if (iter == phases.end()) {
+        phases.push_back(std::make_pair(e.name, Phase{0, 0, 0, ""}));
+        iter = phases.end() - 1;
+      }
+      iter->second.total += d;
+      iter->second.count += 1;
+      if (d >= iter->second.max) {
+        iter->second.max = d;
+        iter->second.slowest = e.track;
+      }
+      cfTotals[e.track] += d;
+      auto& slowest = cfSlowestPhase[e.track];
+      if (d >= slowest.second) {
+        slowest = std::make_pair(e.name, d);
+      }
+    }
+
+    std::stringstream sstr;
+    sstr << std::fixed << std::setprecision(3);
+    sstr << "Startup phases (sum over all CFs; with interleaving it exceeds the wall time):" << std::endl;
+    sstr << "  " << std::left << std::setw(16) << "phase" << std::right
+         << std::setw(6) << "count" << std::setw(10) << "total" << std::setw(10) << "mean"
+         << std::setw(10) << "max" << "  slowest" << std::endl;
+    for (const auto& p : phases) {
+      sstr << "  " << std::left << std::setw(16) << p.first << std::right
+           << std::setw(6) << p.second.count
+           << std::setw(10) << p.second.total
+           << std::setw(10) << p.second.total / p.second.count
+           << std::setw(10) << p.second.max
+           << "  " << p.second.slowest << std::endl;
+    }
+
+    std::vector<std::pair<std::string, double> > cfs(cfTotals.begin(), cfTotals.end());
+    std::sort(cfs.begin(), cfs.end(),
+      [](const std::pair<std::string, double>& a, const std::pair<std::string, double>& b) { return a.second > b.second; });
+    sstr << "Slowest CFs:" << std::endl;
+    for (size_t i = 0; i < std::min(numSlowest, cfs.size()); ++i) {
+      const auto& slowest = cfSlowestPhase[cfs[i].first];
+      sstr << "  " << std::left << std::setw(16) << cfs[i].first << std::right
+           << std::setw(10) << cfs[i].second << " s (longest: " << slowest.first
+           << " " << slowest.second << " s";
+      for (const auto& e : m_events) {
+        if (e.track == cfs[i].first && e.name == slowest.first) {
+          for (const auto& a : e.args) {
+            sstr << ", " << a.first << ": " << a.second;
+          }
+        }
+      }
+      sstr << ")" << std::endl;
+    }
+    return sstr.str();
+  }
+
+private:
+  void record(const Event& event)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back(event);
+  }
+
+  long long micros(clock::time_point t) const
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - m_origin).count();
+  }
+
+  static double seconds(const Event& e)
+  {
+    return std::chrono::duration<double>(e.end - e.start).count();
+  }
+
+  clock::time_point m_origin;
+  mutable std::mutex m_mutex;
+  std::vector<Event> m_events;
+};
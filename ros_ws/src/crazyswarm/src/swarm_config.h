@@ -0,0 +1,223 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+
+/*
+Swarm configuration (crazyflies, crazyflieTypes, marker and dynamics configurations)
+ * Read once at startup with one parameter server call per top-level key and kept in plain
+   structs, which all groups share read-only.
+*/
+
+class SwarmConfig
+{
+public:
+  struct CrazyflieConfig
+  {
+    int id;
+    int channel;
+    std::string type;
+    std::array<double, 3> initialPosition;
+  };
+
+  struct FirmwareParam
+  {
+    std::string group;
+    std::string name;
+    double value;
+  };
+
+  struct TypeConfig
+  {
+    int markerConfiguration;
+    int dynamicsConfiguration;
+    std::vector<FirmwareParam> firmwareParams;
+  };
+
+  struct MarkerConfiguration
+  {
+    // marker positions (offset already applied)
+    std::vector<std::array<double, 3> > points;
+  };
+
+  struct DynamicsConfiguration
+  {
+    double maxXVelocity;
+    double maxYVelocity;
+    double maxZVelocity;
+    double maxPitchRate;
+    double maxRollRate;
+    double maxYawRate;
+    double maxRoll;
+    double maxPitch;
+    double maxFitnessScore;
+  };
+
+  std::vector<CrazyflieConfig> crazyflies;
+  std::map<std::string, TypeConfig> types;
+  std::vector<MarkerConfiguration> markerConfigurations;
+  std::vector<DynamicsConfiguration> dynamicsConfigurations;
+
+  std::set<int> channels() const
+  {
+    std::set<int> result;
+    for (const auto& cf : crazyflies) {
+      result.insert(cf.channel);
+    }
+    return result;
+  }
+
+  const TypeConfig& type(const std::string& name) const
+  {
+    auto iter = types.find(name);
+    if (iter == types.end()) {
+      throw std::runtime_error("Unknown crazyflie type " + name + "!");
+    }
+    return iter->second;
+  }
+
+  // The raw parameters (one parameter server call per top-level key)
+  struct Parameters
+  {
+    XmlRpc::XmlRpcValue crazyflies;
+    XmlRpc::XmlRpcValue crazyflieTypes;
+    int numMarkerConfigurations;
+    XmlRpc::XmlRpcValue markerConfigurations;
+    int numDynamicsConfigurations;
+    XmlRpc::XmlRpcValue dynamicsConfigurations;
+
+    void read(
+      const ros::NodeHandle& n)
+    {
+      n.getParam("crazyflies", crazyflies);
+      n.getParam("crazyflieTypes", crazyflieTypes);
+      numMarkerConfigurations = 0;
+      n.getParam("numMarkerConfigurations", numMarkerConfigurations);
+      if (numMarkerConfigurations > 0) {
+        n.getParam("markerConfigurations", markerConfigurations);
+      }
+      numDynamicsConfigurations = 0;
+      n.getParam("numDynamicsConfigurations", numDynamicsConfigurations);
+      if (numDynamicsConfigurations > 0) {
+        n.getParam("dynamicsConfigurations", dynamicsConfigurations);
+      }
+    }
+  };
+
+  void readFromParameterServer(
+    const ros::NodeHandle& n)
+  {
+    Parameters parameters;
+    parameters.read(n);
+    parse(parameters);
+  }
+
+  void parse(
+    Parameters& parameters)
+  {
+    XmlRpc::XmlRpcValue& value = parameters.crazyflies;
+
+    crazyflies.clear();
+    check(value.getType() == XmlRpc::XmlRpcValue::TypeArray, "crazyflies");
+    for (int i = 0; i < value.size(); ++i) {
+      XmlRpc::XmlRpcValue& crazyflie = value[i];
+      check(crazyflie.getType() == XmlRpc::XmlRpcValue::TypeStruct, "crazyflies");
+      CrazyflieConfig config;
+      config.id = crazyflie["id"];
+      config.channel = crazyflie["channel"];
+      config.type = static_cast<std::string>(crazyflie["type"]);
+      XmlRpc::XmlRpcValue& pos = crazyflie["initialPosition"];
+      check(pos.getType() == XmlRpc::XmlRpcValue::TypeArray && pos.size() == 3, "initialPosition");
+      for (int j = 0; j < 3; ++j) {
+        config.initialPosition[j] = toDouble(pos[j], "initialPosition");
+      }
+      crazyflies.push_back(config);
+    }
+
+    types.clear();
+    XmlRpc::XmlRpcValue& typeValues = parameters.crazyflieTypes;
+    check(typeValues.getType() == XmlRpc::XmlRpcValue::TypeStruct, "crazyflieTypes");
+    for (auto iter = typeValues.begin(); iter != typeValues.end(); ++iter) {
+      XmlRpc::XmlRpcValue& t = iter->second;
+      TypeConfig& config = types[iter->first];
+      config.markerConfiguration = t["markerConfiguration"];
+      config.dynamicsConfiguration = t["dynamicsConfiguration"];
+      if (t.hasMember("firmwareParams")) {
+        XmlRpc::XmlRpcValue& params = t["firmwareParams"];
+        for (auto group = params.begin(); group != params.end(); ++group) {
+          for (auto param = group->second.begin(); param != group->second.end(); ++param) {
+            double v;
+            if (param->second.getType() == XmlRpc::XmlRpcValue::TypeBoolean) {
+              v = (bool)param->second ? 1 : 0;
+            } else {
+              v = toDouble(param->second, group->first + "." + param->first);
+            }
+            config.firmwareParams.push_back({group->first, param->first, v});
+          }
+        }
+      }
+    }
+
+    markerConfigurations.clear();
+    for (int i = 0; i < parameters.numMarkerConfigurations; ++i) {
+      XmlRpc::XmlRpcValue& m = member(parameters.markerConfigurations, std::to_string(i), "markerConfigurations");
+      XmlRpc::XmlRpcValue& offset = m["offset"];
+      int numPoints = m["numPoints"];
+      markerConfigurations.resize(markerConfigurations.size() + 1);
+      for (int j = 0; j < numPoints; ++j) {
+        XmlRpc::XmlRpcValue& point = member(m["points"], std::to_string(j), "markerConfigurations");
+        std::array<double, 3> p;
+        for (int k = 0; k < 3; ++k) {
+          p[k] = toDouble(point[k], "points") + toDouble(offset[k], "offset");
+        }
+        markerConfigurations.back().points.push_back(p);
+      }
+    }
+
+    dynamicsConfigurations.clear();
+    for (int i = 0; i < parameters.numDynamicsConfigurations; ++i) {
+      XmlRpc::XmlRpcValue& d = member(parameters.dynamicsConfigurations, std::to_string(i), "dynamicsConfigurations");
+      DynamicsConfiguration config;
+      config.maxXVelocity = toDouble(d["maxXVelocity"], "maxXVelocity");
+      config.maxYVelocity = toDouble(d["maxYVelocity"], "maxYVelocity");
+      config.maxZVelocity = toDouble(d["maxZVelocity"], "maxZVelocity");
+      config.maxPitchRate = toDouble(d["maxPitchRate"], "maxPitchRate");
+      config.maxRollRate = toDouble(d["maxRollRate"], "maxRollRate");
+      config.maxYawRate = toDouble(d["maxYawRate"], "maxYawRate");
+      config.maxRoll = toDouble(d["maxRoll"], "maxRoll");
+      config.maxPitch = toDouble(d["maxPitch"], "maxPitch");
+      config.maxFitnessScore = toDouble(d["maxFitnessScore"], "maxFitnessScore");
+      dynamicsConfigurations.push_back(config);
+    }
+  }
+
+private:
+  static void check(bool condition, const std::string& what)
+  {
+    if (!condition) {
+      throw std::runtime_error("Invalid swarm configuration (" + what + ")!");
+    }
+  }
+
+  static double toDouble(XmlRpc::XmlRpcValue& v, const std::string& what)
+  {
+    if (v.getType() == XmlRpc::XmlRpcValue::TypeInt) {
+      return (int)v;
+    }
+    check(v.getType() == XmlRpc::XmlRpcValue::TypeDouble, what);
+    return static_cast<double>(v);
+  }
+
+  static XmlRpc::XmlRpcValue& member(XmlRpc::XmlRpcValue& v, const std::string& name, const std::string& what)
+  {
+    check(v.getType() == XmlRpc::XmlRpcValue::TypeStruct && v.hasMember(name), what + "/" + name);
+    return v[name];
+  }
+};
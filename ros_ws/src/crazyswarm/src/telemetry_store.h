@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+In-memory telemetry store
+ * Keeps the last N seconds of every logged variable of every CF in fixed-size ring buffers.
+ * Memory is allocated once per log block (when the block is added); appending never allocates.
+ * Each log block has its own lock, so the radio threads of different groups do not contend.
+ * Timestamps are host receive times (seconds), as CF timestamps are not synchronized.
+*/
+
+class TelemetryStore
+{
+public:
+  class Block
+  {
+  public:
+    Block(
+      const std::vector<std::string>& variables,
+      size_t capacity)
+      : m_variables(variables)
+      , m_capacity(std::max<size_t>(capacity, 1))
+      , m_times(m_capacity)
+      , m_values(m_capacity * variables.size())
+      , m_head(0)
+      , m_size(0)
+    {
+    }
+
+    void append(double time, const std::vector<double>& values)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_times[m_head] = time;
+      size_t n = std::min(values.size(), m_variables.size());
+      float* row = &m_values[m_head * m_variables.size()];
+      for (size_t i = 0; i < n; ++i) {
+        row[i] = values[i];
+      }
+      m_head = (m_head + 1) % m_capacity;
+      m_size = std::min(m_size + 1, m_capacity);
+    }
+
+    int column(const std::string& variable) const
+    {
+      for (size_t i = 0; i < m_variables.size(); ++i) {
+        if (m_variables[i] == variable) {
+          return i;
+        }
+      }
+      return -1;
+    }
+
+    // copies all samples of the given column with time >= tStart (oldest first)
+    void window(int column, double tStart, std::vector<double>& times, std::vector<double>& values) const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      size_t first = (m_head + m_capacity - m_size) % m_capacity;
+      for (size_t k = 0; k < m_size; ++k) {
+        size_t idx = (first + k) % m_capacity;
+        if (m_times[idx] >= tStart) {
+          times.push_back(m_times[idx]);
+          values.push_back(m_values[idx * m_variables.size() + column]);
+        }
+      }
+    }
+
+    // returns false if the block is empty
+    bool latest(int column, double& time, double& value) const
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_size == 0) {
+        return false;
+      }
+      size_t idx = (m_head + m_capacity - 1) % m_capacity;
+      time = m_times[idx];
+      value = m_values[idx * m_variables.size() + column];
+      return true;
+    }
+
+  private:
+    mutable std::mutex m_mutex;
+    std::vector<std::string> m_variables;
+    size_t m_capacity;
+    std::vector<double> m_times;
+    std::vector<float> m_values;
+    size_t m_head;
+    size_t m_size;
+  };
+
+  struct Stats
+  {
+    double min;
+    double max;
+    double mean;
+    size_t count;
+  };
+
+  TelemetryStore(
+    double windowSeconds)
+    : m_windowSeconds(windowSeconds)
+  {
+  }
+
+  double windowSeconds() const {
+    return m_windowSeconds;
+  }
+
+  // Adds a log block of a CF. The returned block stays valid for the lifetime of the store.
+  Block* addBlock(
+    int id,
+    const std::vector<std::string>& variables,
+    double frequency)
+  {
+    // some headroom, in case the CF sends slightly faster than planned
+    size_t capacity = std::ceil(m_windowSeconds * frequency * 1.2) + 1;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_blocks[id].emplace_back(new Block(variables, capacity));
+    return m_blocks[id].back().get();
+  }
+
+  // Removes a block of a CF (e.g., when the CF is removed from the swarm)
+  void removeBlock(
+    int id,
+    const Block* block)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_blocks.find(id);
+    if (iter == m_blocks.end()) {
+      return;
+    }
+    auto& blocks = iter->second;
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(),
+      [&](const std::unique_ptr<Block>& b) { return b.get() == block; }), blocks.end());
+    if (blocks.empty()) {
+      m_blocks.erase(iter);
+    }
+  }
+
+  void ids(std::vector<int>& result) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& entry : m_blocks) {
+      result.push_back(entry.first);
+    }
+  }
+
+  // Returns false if the CF does not log the given variable
+  bool window(
+    int id,
+    const std::string& variable,
+    double tStart,
+    std::vector<double>& times,
+    std::vector<double>& values) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_blocks.find(id);
+    if (iter == m_blocks.end()) {
+      return false;
+    }
+    for (const auto& block : iter->second) {
+      int column = block->column(variable);
+      if (column >= 0) {
+        block->window(column, tStart, times, values);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Returns false if the CF does not log the given variable or did not send it yet
+  bool latest(
+    int id,
+    const std::string& variable,
+    double& time,
+    double& value) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto iter = m_blocks.find(id);
+    if (iter == m_blocks.end()) {
+      return false;
+    }
+    for (const auto& block : iter->second) {
+      int column = block->column(variable);
+      if (column >= 0) {
+        return block->latest(column, time, value);
+      }
+    }
+    return false;
+  }
+
+  // Reduces a series to at most maxSamples samples by averaging equally sized buckets
+  static void downsample(
+    std::vector<double>& times,
+    std::vector<double>& values,
+    size_t maxSamples)
+  {
+    if (maxSamples == 0 || times.size() <= maxSamples) {
+      return;
+    }
+    size_t n = times.size();
+    for (size_t b = 0; b < maxSamples; ++b) {
+      size_t begin = b * n / maxSamples;
+      size_t end = (b + 1) * n / maxSamples;
+      double t = 0;
+      double v = 0;
+      for (size_t i = begin; i < end; ++i) {
+        t += times[i];
+        v += values[i];
+      }
+      times[b] = t / (end - begin);
+      values[b] = v / (end - begin);
+    }
+    times.resize(maxSamples);
+    values.resize(maxSamples);
+  }
+
+  static Stats stats(const std::vector<double>& values)
+  {
+    Stats s;
+    s.min = std::numeric_limits<double>::quiet_NaN();
+    s.max = std::numeric_limits<double>::quiet_NaN();
+    s.mean = std::numeric_limits<double>::quiet_NaN();
+    s.count = values.size();
+    if (!values.empty()) {
+      s.min = *std::min_element(values.begin(), values.end());
+      s.max = *std::max_element(values.begin(), values.end());
+      double sum = 0;
+      for (double v : values) {
+        sum += v;
+      }
+      s.mean = sum / values.size();
+    }
+    return s;
+  }
+
+private:
+  mutable std::mutex m_mutex;
+  double m_windowSeconds;
+  std::map<int, std::vector<std::unique_ptr<Block> > > m_blocks;
+};
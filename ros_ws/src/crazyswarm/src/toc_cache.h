@@ -0,0 +1,143 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+
+/*
+Swarm-wide TOC cache coordination
+ * crazyflie_cpp caches each TOC on disk, keyed by the TOC CRC (e.g., params<crc>.csv in the
+   working directory). Fetching a cached TOC only costs the info request.
+ * If all CFs start at the same time, they all miss the cache. Therefore, the first fetch of
+   each kind of TOC (param, log) in the swarm runs alone; all other CFs wait and then find
+   the TOC in the cache.
+ * Each fetched TOC is identified by a fingerprint of its content. Fingerprints are kept in an
+   index file, so that hits and misses can be reported across server restarts.
+*/
+
+class TocCache
+{
+public:
+  TocCache(
+    const std::string& indexFileName)
+    : m_indexFileName(indexFileName)
+  {
+    std::ifstream file(m_indexFileName);
+    std::string kind;
+    uint64_t fingerprint;
+    while (file >> kind >> std::hex >> fingerprint) {
+      m_known.insert(std::make_pair(kind, fingerprint));
+    }
+  }
+
+  // FNV-1a, used to fingerprint TOC entries
+  static uint64_t hash(const std::string& data, uint64_t h = 14695981039346656037ULL)
+  {
+    return hash(reinterpret_cast<const uint8_t*>(data.data()), data.size(), h);
+  }
+
+  static uint64_t hash(const uint8_t* data, size_t size, uint64_t h = 14695981039346656037ULL)
+  {
+    for (size_t i = 0; i < size; ++i) {
+      h ^= data[i];
+      h *= 1099511628211ULL;
+    }
+    return h;
+  }
+
+  // Blocks while another CF does the first fetch of this kind of TOC.
+  // Returns true if the caller is the one to do the first fetch. With
+  // forceNoCache, every CF fetches its own TOC, so nothing is serialized.
+  bool beginFetch(const std::string& kind, bool forceNoCache)
+  {
+    if (forceNoCache) {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    State& state = m_states[kind];
+    m_cv.wait(lock, [&]{ return state.primed || !state.fetching; });
+    if (!state.primed) {
+      state.fetching = true;
+      return true;
+    }
+    return false;
+  }
+
+  // Must be called instead of endFetch if the fetch failed
+  void abortFetch(const std::string& kind, bool first)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (first) {
+      m_states[kind].fetching = false;
+      m_cv.notify_all();
+    }
+  }
+
+  // Records the fetched TOC; returns true if its content was already cached.
+  bool endFetch(const std::string& kind, bool first, uint64_t fingerprint, bool forceNoCache)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    State& state = m_states[kind];
+    if (first) {
+      state.primed = true;
+      state.fetching = false;
+      m_cv.notify_all();
+    }
+
+    bool hit = !forceNoCache && m_known.count(std::make_pair(kind, fingerprint)) > 0;
+    if (hit) {
+      ++state.hits;
+    } else {
+      ++state.misses;
+      if (m_known.insert(std::make_pair(kind, fingerprint)).second) {
+        std::ofstream file(m_indexFileName, std::ios::app);
+        file << kind << " " << std::hex << fingerprint << std::endl;
+      }
+    }
+    state.fingerprints.insert(fingerprint);
+    return hit;
+  }
+
+  std::string summary()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::stringstream sstr;
+    sstr << "TOC cache:";
+    for (const auto& entry : m_states) {
+      sstr << " " << entry.first << ": " << entry.second.hits << " hits, "
+           << entry.second.misses << " misses, "
+           << entry.second.fingerprints.size() << " distinct TOC(s);";
+    }
+    return sstr.str();
+  }
+
+private:
+  struct State
+  {
+    State()
+      : primed(false)
+      , fetching(false)
+      , hits(0)
+      , misses(0)
+      , fingerprints()
+    {
+    }
+
+    bool primed;
+    bool fetching;
+    size_t hits;
+    size_t misses;
+    std::set<uint64_t> fingerprints;
+  };
+
+  std::string m_indexFileName;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::map<std::string, State> m_states;
+  std::set<std::pair<std::string, uint64_t> > m_known;
+};
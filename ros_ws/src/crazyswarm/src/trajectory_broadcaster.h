@@ -0,0 +1,189 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <crazyflie_cpp/Crazyflie.h>
+
+/*
+Broadcast trajectory upload
+ * Writes poly4d pieces into the trajectory memory of all CFs of a radio at once (CRTP memory
+   writes to the broadcast address) and defines the trajectory with a broadcast high-level
+   command. The airtime is independent of the number of CFs.
+ * Broadcasts are not acknowledged, so every packet is repeated (in rounds, to spread out burst
+   losses). numRepeats() picks the number of rounds for the link quality of the CFs, using
+   completeProbability(), the chance that a CF received every packet (including the definition).
+ * Each CF is verified afterwards: the firmware logs a checksum of the memory of the last defined
+   trajectory (checksum(), Fletcher-16 over its bytes), which the server compares with the one
+   of the pieces. CFs that do not match get a unicast upload. The checksum fits into the float
+   of the telemetry store exactly; it misses 1 in 65536 corrupted uploads.
+ * Requires the same trajectory memory id on all CFs (same firmware).
+ * Also writes parameters by broadcast (writeParam), which requires the same param TOC on all CFs.
+*/
+
+class TrajectoryBroadcaster : public CrazyflieBroadcaster
+{
+public:
+  TrajectoryBroadcaster(
+    const std::string& link_uri)
+    : CrazyflieBroadcaster(link_uri)
+  {
+  }
+
+  // payload of a memory write packet
+  static constexpr size_t MemoryWriteSize = 24;
+
+  static size_t numPackets(size_t numPieces)
+  {
+    return (numPieces * sizeof(Crazyflie::poly4d) + MemoryWriteSize - 1) / MemoryWriteSize;
+  }
+
+  // Probability that a CF received at least one copy of each packet (memory
+  // writes and the definition), if a single broadcast reaches it with the given
+  // probability
+  static double completeProbability(size_t numPieces, size_t numRepeats, double linkQuality)
+  {
+    double packet = 1.0 - std::pow(1.0 - linkQuality, numRepeats);
+    return std::pow(packet, numPackets(numPieces) + 1);
+  }
+
+  // Fletcher-16 over the bytes of the pieces, as logged by the firmware for the
+  // last defined trajectory
+  static uint16_t checksum(const std::vector<Crazyflie::poly4d>& pieces)
+  {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(pieces.data());
+    size_t size = pieces.size() * sizeof(Crazyflie::poly4d);
+    uint32_t sum1 = 0;
+    uint32_t sum2 = 0;
+    for (size_t i = 0; i < size; ++i) {
+      sum1 = (sum1 + data[i]) % 255;
+      sum2 = (sum2 + sum1) % 255;
+    }
+    return (sum2 << 8) | sum1;
+  }
+
+  // Smallest number of repeats (at most maxRepeats) for which a CF with the given
+  // link quality received every packet with the given confidence
+  static size_t numRepeats(size_t numPieces, double linkQuality, double confidence, size_t maxRepeats)
+  {
+    size_t repeats = 1;
+    while (repeats < maxRepeats && completeProbability(numPieces, repeats, linkQuality) < confidence) {
+      ++repeats;
+    }
+    return repeats;
+  }
+
+  // Holds the mutex only while sending a packet, so that other broadcasts on the
+  // same radio (e.g., poses) continue during the upload
+  void uploadTrajectory(
+    uint8_t memoryId,
+    uint8_t trajectoryId,
+    uint32_t pieceOffset,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    size_t numRepeats,
+    std::chrono::microseconds delayBetweenPackets,
+    std::mutex& mutex)
+  {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(pieces.data());
+    size_t size = pieces.size() * sizeof(Crazyflie::poly4d);
+    uint32_t address = pieceOffset * sizeof(Crazyflie::poly4d);
+
+    for (size_t r = 0; r < numRepeats; ++r) {
+      for (size_t offset = 0; offset < size; offset += MemoryWriteSize) {
+        memoryWriteRequest request(memoryId, address + offset);
+        size_t length = size - offset < MemoryWriteSize ? size - offset : MemoryWriteSize;
+        std::memcpy(request.data, data + offset, length);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          sendPacket(reinterpret_cast<const uint8_t*>(&request), sizeof(request) - MemoryWriteSize + length);
+        }
+        std::this_thread::sleep_for(delayBetweenPackets);
+      }
+    }
+
+    defineTrajectoryRequest define(trajectoryId, address, pieces.size());
+    for (size_t r = 0; r < numRepeats; ++r) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        sendPacket(reinterpret_cast<const uint8_t*>(&define), sizeof(define));
+      }
+      std::this_thread::sleep_for(delayBetweenPackets);
+    }
+  }
+
+  // Parameter write (CRTP param port, write channel) with the TOC id and the value in
+  // the TOC type of the parameter
+  template<class T>
+  void writeParam(
+    uint8_t id,
+    T value)
+  {
+    paramWriteRequest<T> request(id, value);
+    sendPacket(reinterpret_cast<const uint8_t*>(&request), sizeof(request));
+  }
+
+private:
+  // CRTP header: port (4 bits), link (2 bits), channel (2 bits)
+  static constexpr uint8_t header(uint8_t port, uint8_t channel)
+  {
+    return (port << 4) | (3 << 2) | (channel & 0x03);
+  }
+
+  struct memoryWriteRequest
+  {
+    memoryWriteRequest(uint8_t memId, uint32_t memAddr)
+      : header(TrajectoryBroadcaster::header(0x04, 2))
+      , memId(memId)
+      , memAddr(memAddr)
+    {
+    }
+
+    uint8_t header;
+    uint8_t memId;
+    uint32_t memAddr;
+    uint8_t data[MemoryWriteSize];
+  } __attribute__((packed));
+
+  template<class T>
+  struct paramWriteRequest
+  {
+    paramWriteRequest(uint8_t id, T value)
+      : header(TrajectoryBroadcaster::header(0x02, 2))
+      , id(id)
+      , value(value)
+    {
+    }
+
+    uint8_t header;
+    uint8_t id;
+    T value;
+  } __attribute__((packed));
+
+  struct defineTrajectoryRequest
+  {
+    defineTrajectoryRequest(uint8_t trajectoryId, uint32_t offset, uint8_t numPieces)
+      : header(TrajectoryBroadcaster::header(0x08, 0))
+      , command(6) // COMMAND_DEFINE_TRAJECTORY
+      , trajectoryId(trajectoryId)
+      , location(0) // TRAJECTORY_LOCATION_MEM
+      , type(0) // TRAJECTORY_TYPE_POLY4D
+      , offset(offset)
+      , numPieces(numPieces)
+    {
+    }
+
+    uint8_t header;
+    uint8_t command;
+    uint8_t trajectoryId;
+    uint8_t location;
+    uint8_t type;
+    uint32_t offset;
+    uint8_t numPieces;
+  } __attribute__((packed));
+};
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <crazyflie_cpp/Crazyflie.h>
+
+/*
+Compact trajectory encoding
+ * A poly4d piece is 4 axes x 8 float coefficients plus a float duration (132 bytes). Many pieces
+   (hover, takeoff, slow segments) have zero or tiny higher-order coefficients.
+ * Each axis of a piece is stored in fixed point: the coefficients are normalized to the piece
+   duration (a_i = c_i * T^i, i.e., polynomials in s = t / T in [0, 1]), quantized to int16 with a
+   per-axis power-of-two scale, and trailing zero coefficients are dropped.
+ * The step is chosen such that the error of the 8 normalized terms adds up to at most maxError
+   (meters for x, y, z; radians for yaw) anywhere in the piece. Axes that do not fit into int16
+   with that step are stored as floats.
+ * Layout per piece: float duration, then per axis: uint8 count (bit 7: floats), int8 exponent,
+   count coefficients (int16 or float). Little endian, like the CF.
+ * verify() evaluates the decoded pieces against the original ones, since the bound does not
+   cover float rounding.
+*/
+
+class TrajectoryEncoding
+{
+public:
+  static constexpr size_t NumAxes = 4;
+  static constexpr size_t NumCoefficients = 8;
+
+  struct Stats
+  {
+    size_t rawBytes;
+    size_t encodedBytes;
+    double maxError;   // measured by verify()
+  };
+
+  static size_t rawSize(size_t numPieces) {
+    return numPieces * sizeof(Crazyflie::poly4d);
+  }
+
+  static void encode(
+    const std::vector<Crazyflie::poly4d>& pieces,
+    double maxError,
+    std::vector<uint8_t>& encoded)
+  {
+    encoded.clear();
+    for (const auto& piece : pieces) {
+      append(encoded, piece.duration);
+      double T = normalization(piece.duration);
+      for (size_t axis = 0; axis < NumAxes; ++axis) {
+        double a[NumCoefficients];
+        for (size_t i = 0; i < NumCoefficients; ++i) {
+          a[i] = piece.p[axis][i] * std::pow(T, i);
+        }
+        // quantization error per term at most step / 2
+        int exponent = maxError > 0 ? std::floor(std::log2(2.0 * maxError / NumCoefficients)) : 0;
+        exponent = std::max(exponent, (int)std::numeric_limits<int8_t>::min());
+        double step = std::ldexp(1.0, exponent);
+
+        int16_t q[NumCoefficients];
+        bool fits = maxError > 0;
+        for (size_t i = 0; i < NumCoefficients && fits; ++i) {
+          double k = std::round(a[i] / step);
+          fits = std::abs(k) <= std::numeric_limits<int16_t>::max();
+          q[i] = fits ? (int16_t)k : 0;
+        }
+
+        if (fits) {
+          uint8_t count = NumCoefficients;
+          while (count > 0 && q[count - 1] == 0) {
+            --count;
+          }
+          encoded.push_back(count);
+          encoded.push_back((uint8_t)(int8_t)exponent);
+          for (size_t i = 0; i < count; ++i) {
+            append(encoded, q[i]);
+          }
+        } else {
+          uint8_t count = NumCoefficients;
+          while (count > 0 && piece.p[axis][count - 1] == 0) {
+            --count;
+          }
+          encoded.push_back(count | FloatFlag);
+          encoded.push_back(0);
+          for (size_t i = 0; i < count; ++i) {
+            append(encoded, piece.p[axis][i]);
+          }
+        }
+      }
+    }
+  }
+
+  // Returns false if the data is truncated
+  static bool decode(
+    const std::vector<uint8_t>& encoded,
+    std::vector<Crazyflie::poly4d>& pieces)
+  {
+    pieces.clear();
+    size_t pos = 0;
+    while (pos < encoded.size()) {
+      Crazyflie::poly4d piece;
+      std::memset(&piece, 0, sizeof(piece));
+      float duration;
+      if (!read(encoded, pos, duration)) {
+        return false;
+      }
+      piece.duration = duration;
+      double T = normalization(piece.duration);
+      for (size_t axis = 0; axis < NumAxes; ++axis) {
+        if (pos + 2 > encoded.size()) {
+          return false;
+        }
+        uint8_t count = encoded[pos] & ~FloatFlag;
+        bool floats = encoded[pos] & FloatFlag;
+        int exponent = (int8_t)encoded[pos + 1];
+        pos += 2;
+        if (count > NumCoefficients) {
+          return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+          if (floats) {
+            float c;
+            if (!read(encoded, pos, c)) {
+              return false;
+            }
+            piece.p[axis][i] = c;
+          } else {
+            int16_t k;
+            if (!read(encoded, pos, k)) {
+              return false;
+            }
+            piece.p[axis][i] = std::ldexp((double)k, exponent) / std::pow(T, i);
+          }
+        }
+      }
+      pieces.push_back(piece);
+    }
+    return true;
+  }
+
+  // Largest difference (any axis) between the pieces, sampled numSamples
+  // times per piece including both ends
+  static double verify(
+    const std::vector<Crazyflie::poly4d>& original,
+    const std::vector<Crazyflie::poly4d>& decoded,
+    size_t numSamples = 32)
+  {
+    if (original.size() != decoded.size()) {
+      return std::numeric_limits<double>::infinity();
+    }
+    double result = 0;
+    for (size_t p = 0; p < original.size(); ++p) {
+      for (size_t s = 0; s < numSamples; ++s) {
+        double t = original[p].duration * s / std::max<size_t>(numSamples - 1, 1);
+        for (size_t axis = 0; axis < NumAxes; ++axis) {
+          double error = std::abs(evaluate(original[p], axis, t) - evaluate(decoded[p], axis, t));
+          result = std::max(result, error);
+        }
+      }
+    }
+    return result;
+  }
+
+  // Encodes, decodes and verifies; decoded is left empty if the error is too large
+  static Stats check(
+    const std::vector<Crazyflie::poly4d>& pieces,
+    double maxError,
+    std::vector<Crazyflie::poly4d>& decoded)
+  {
+    std::vector<uint8_t> encoded;
+    encode(pieces, maxError, encoded);
+    Stats stats{rawSize(pieces.size()), encoded.size(), std::numeric_limits<double>::infinity()};
+    if (decode(encoded, decoded)) {
+      stats.maxError = verify(pieces, decoded);
+    }
+    if (!(stats.maxError <= maxError)) {
+      decoded.clear();
+    }
+    return stats;
+  }
+
+private:
+  static constexpr uint8_t FloatFlag = 0x80;
+
+  // pieces without duration are stored without normalization
+  static double normalization(float duration) {
+    return duration > 0 ? duration : 1.0;
+  }
+
+  static double evaluate(const Crazyflie::poly4d& piece, size_t axis, double t)
+  {
+    double result = 0;
+    for (int i = NumCoefficients - 1; i >= 0; --i) {
+      result = result * t + piece.p[axis][i];
+    }
+    return result;
+  }
+
+  template<class T>
+  static void append(std::vector<uint8_t>& data, T value)
+  {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+  }
+
+  template<class T>
+  static bool read(const std::vector<uint8_t>& data, size_t& pos, T& value)
+  {
+    if (pos + sizeof(T) > data.size()) {
+      return false;
+    }
+    std::memcpy(&value, &data[pos], sizeof(T));
+    pos += sizeof(T);
+    return true;
+  }
+};
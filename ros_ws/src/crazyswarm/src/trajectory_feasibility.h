@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "parallel_for.h"
+#include "piecewise_batch.h"
+
+/*
+Feasibility of trajectories for the dynamics limits of the CFs (see dynamicsConfigurations)
+ * Samples each trajectory every sampleTime seconds and checks the velocity per axis, the tilt
+   (bounds roll and pitch) and collective thrust implied by the acceleration, the body rates
+   implied by the jerk (differential flatness), and the yaw rate.
+ * Stretching a trajectory by s scales velocity by 1 / s, acceleration by 1 / s^2, and jerk by
+   1 / s^3. For each sample, the smallest s that satisfies all limits is solved in closed form
+   (velocity, tilt, thrust) or by bisection (body rates); the largest over all samples gives the
+   fastest feasible timescale (minTimescale).
+ * Trajectories are checked in parallel, each one in blocks of PiecewiseBatch::BlockSize samples.
+ * FeasibilityChecker keeps the limits per CF type (as the server does for every upload).
+*/
+
+struct FeasibilityLimits
+{
+  double maxVelocityX;      // m/s
+  double maxVelocityY;
+  double maxVelocityZ;
+  double maxTilt;           // rad, e.g., min(maxRoll, maxPitch)
+  double maxBodyRate;       // rad/s, roll and pitch, e.g., min(maxRollRate, maxPitchRate)
+  double maxYawRate;        // rad/s
+  double maxThrustToWeight; // collective thrust / weight
+};
+
+struct FeasibilityResult
+{
+  enum Violation {
+    None = 0,
+    VelocityX,
+    VelocityY,
+    VelocityZ,
+    Tilt,
+    Thrust,
+    BodyRate,
+    YawRate,
+  };
+
+  // first violation at the timescale of the trajectory
+  Violation violation;
+  double time;           // s, since the start of the trajectory
+  double value;
+  double limit;
+  // fastest feasible timescale (infinity: not feasible at any timescale)
+  double minTimescale;
+
+  bool feasible() const {
+    return violation == None;
+  }
+
+  // e.g., "tilt 1.52 rad exceeds 1.4 rad at t = 2.3 s (fastest feasible timescale 1.35)"
+  std::string describe() const
+  {
+    static const char* names[] = {"", "x velocity", "y velocity", "z velocity", "tilt", "thrust/weight", "body rate", "yaw rate"};
+    static const char* units[] = {"", " m/s", " m/s", " m/s", " rad", "", " rad/s", " rad/s"};
+    std::stringstream sstr;
+    if (violation != None) {
+      sstr << names[violation] << " " << value << units[violation] << " exceeds " << limit << units[violation]
+           << " at t = " << time << " s ";
+    }
+    sstr << "(fastest feasible timescale " << minTimescale << ")";
+    return sstr.str();
+  }
+};
+
+class TrajectoryFeasibility
+{
+public:
+  static constexpr double Gravity = 9.81;
+
+  // limits: one per trajectory, or one for all; numThreads = 0: all cores
+  static void check(
+    const PiecewiseBatch& trajectories,
+    const std::vector<FeasibilityLimits>& limits,
+    double sampleTime,
+    std::vector<FeasibilityResult>& results,
+    size_t numThreads = 1)
+  {
+    if (limits.size() != 1 && limits.size() != trajectories.size()) {
+      throw std::runtime_error("limits have to be given once or per trajectory");
+    }
+    if (!(sampleTime > 0)) {
+      throw std::runtime_error("sampleTime has to be positive");
+    }
+    results.resize(trajectories.size());
+    numThreads = threadCount(numThreads, trajectories.size());
+
+    auto work = [&](size_t thread) {
+      for (size_t i = thread; i < trajectories.size(); i += numThreads) {
+        results[i] = check(trajectories, i, limits.size() == 1 ? limits[0] : limits[i], sampleTime);
+      }
+    };
+    parallelFor(numThreads, numThreads, work);
+  }
+
+  static FeasibilityResult check(
+    const PiecewiseBatch& trajectories,
+    size_t index,
+    const FeasibilityLimits& limits,
+    double sampleTime)
+  {
+    const size_t BlockSize = PiecewiseBatch::BlockSize;
+    const size_t NumAxes = PiecewiseBatch::NumAxes;
+    FeasibilityResult result;
+    result.violation = FeasibilityResult::None;
+    result.time = 0;
+    result.value = 0;
+    result.limit = 0;
+    double maxStretch = 0;
+    const double tanTilt = std::tan(limits.maxTilt);
+
+    double duration = trajectories.duration(index);
+    size_t numSamples = (size_t)std::ceil(duration / sampleTime) + 1;
+    std::vector<float> times(BlockSize);
+    std::vector<float> output(4 * NumAxes * BlockSize);
+    for (size_t first = 0; first < numSamples; first += BlockSize) {
+      size_t n = std::min(numSamples - first, BlockSize);
+      for (size_t s = 0; s < n; ++s) {
+        times[s] = std::min((first + s) * sampleTime, duration);
+      }
+      trajectories.evaluateBlock(index, times.data(), n, 3, output.data(), BlockSize);
+      for (size_t s = 0; s < n; ++s) {
+        Sample sample;
+        for (size_t axis = 0; axis < 3; ++axis) {
+          sample.v[axis] = output[(1 * NumAxes + axis) * BlockSize + s];
+          sample.a[axis] = output[(2 * NumAxes + axis) * BlockSize + s];
+          sample.j[axis] = output[(3 * NumAxes + axis) * BlockSize + s];
+        }
+        sample.yawRate = output[(1 * NumAxes + 3) * BlockSize + s];
+        if (result.violation == FeasibilityResult::None && violation(sample, limits, result)) {
+          result.time = times[s];
+        }
+        maxStretch = minStretch(sample, limits, tanTilt, maxStretch);
+      }
+    }
+    result.minTimescale = trajectories.timescale(index) * maxStretch;
+    return result;
+  }
+
+private:
+  struct Sample
+  {
+    double v[3];
+    double a[3];
+    double j[3];
+    double yawRate;
+  };
+
+  static double norm(const double* x) {
+    return std::sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+  }
+
+  // Body rate (roll and pitch) with the trajectory stretched by s
+  static double bodyRate(const Sample& sample, double s)
+  {
+    double u = 1.0 / (s * s);
+    double f[3] = {sample.a[0] * u, sample.a[1] * u, sample.a[2] * u + Gravity};
+    double fNorm = norm(f);
+    if (fNorm < 1e-6) {
+      return std::numeric_limits<double>::infinity();
+    }
+    // h_w = (j - (j . z_b) z_b) / |f| with z_b = f / |f|
+    double u3 = u / s;
+    double j[3] = {sample.j[0] * u3, sample.j[1] * u3, sample.j[2] * u3};
+    double jz = (j[0] * f[0] + j[1] * f[1] + j[2] * f[2]) / fNorm;
+    double h[3];
+    for (size_t i = 0; i < 3; ++i) {
+      h[i] = (j[i] - jz * f[i] / fNorm) / fNorm;
+    }
+    return norm(h);
+  }
+
+  // Sets value and limit of the first limit that the sample exceeds at s = 1
+  static bool violation(const Sample& sample, const FeasibilityLimits& limits, FeasibilityResult& result)
+  {
+    double f[3] = {sample.a[0], sample.a[1], sample.a[2] + Gravity};
+    double fNorm = norm(f);
+    double tilt = fNorm > 0 ? std::acos(f[2] / fNorm) : M_PI;
+    const double values[] = {std::abs(sample.v[0]), std::abs(sample.v[1]), std::abs(sample.v[2]), tilt,
+      fNorm / Gravity, bodyRate(sample, 1.0), std::abs(sample.yawRate)};
+    const double bounds[] = {limits.maxVelocityX, limits.maxVelocityY, limits.maxVelocityZ, limits.maxTilt, limits.maxThrustToWeight, limits.maxBodyRate, limits.maxYawRate};
+    for (size_t i = 0; i < 7; ++i) {
+      if (values[i] > bounds[i]) {
+        result.violation = (FeasibilityResult::Violation)(i + 1);
+        result.value = values[i];
+        result.limit = bounds[i];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Smallest stretch s >= atLeast such that the sample satisfies all limits
+  // (only bisects if the sample needs more than atLeast)
+  static double minStretch(const Sample& sample, const FeasibilityLimits& limits, double tanTilt, double atLeast)
+  {
+    const double infinity = std::numeric_limits<double>::infinity();
+    double s = std::max(std::max(std::abs(sample.v[0]) / limits.maxVelocityX, std::abs(sample.v[1]) / limits.maxVelocityY),
+      std::max(std::abs(sample.v[2]) / limits.maxVelocityZ, std::abs(sample.yawRate) / limits.maxYawRate));
+    s = std::max(s, atLeast);
+
+    // thrust: |a u + g e_z| <= T g with u = 1 / s^2, i.e., |a|^2 u^2 + 2 g a_z u + g^2 (1 - T^2) <= 0
+    const double T = limits.maxThrustToWeight;
+    const double g = Gravity;
+    double a2 = sample.a[0] * sample.a[0] + sample.a[1] * sample.a[1] + sample.a[2] * sample.a[2];
+    if (T < 1) {
+      return infinity;
+    }
+    if (a2 > 0) {
+      double u = (-g * sample.a[2] + std::sqrt(g * g * sample.a[2] * sample.a[2] + a2 * g * g * (T * T - 1))) / a2;
+      s = std::max(s, u > 0 ? 1.0 / std::sqrt(u) : infinity);
+    }
+
+    // tilt: |a_xy| u <= tan(maxTilt) (g + a_z u)
+    if (limits.maxTilt < M_PI / 2) {
+      double c = std::sqrt(sample.a[0] * sample.a[0] + sample.a[1] * sample.a[1]) - tanTilt * sample.a[2];
+      if (c > 0) {
+        s = std::max(s, std::sqrt(c / (tanTilt * g)));
+      }
+    }
+
+    // body rate: grow s until it holds, then bisect
+    if (bodyRate(sample, std::max(s, 1e-3)) > limits.maxBodyRate) {
+      double low = std::max(s, 1e-3);
+      double high = 2 * low;
+      while (bodyRate(sample, high) > limits.maxBodyRate) {
+        low = high;
+        high *= 2;
+        if (high > 1e6) {
+          return infinity;
+        }
+      }
+      for (int i = 0; i < 30; ++i) {
+        double mid = 0.5 * (low + high);
+        (bodyRate(sample, mid) > limits.maxBodyRate ? low : high) = mid;
+      }
+      s = high;
+    }
+    return s;
+  }
+};
+
+// Limits per CF type; const after setup, so it can be shared between threads
+class FeasibilityChecker
+{
+public:
+  FeasibilityChecker()
+    : m_limits()
+    , m_sampleTime(0.01)
+  {
+  }
+
+  void clear() {
+    m_limits.clear();
+  }
+
+  void setLimits(const std::string& type, const FeasibilityLimits& limits) {
+    m_limits[type] = limits;
+  }
+
+  void setSampleTime(double sampleTime) {
+    m_sampleTime = sampleTime;
+  }
+
+  bool empty() const {
+    return m_limits.empty();
+  }
+
+  // Checks the trajectory against the limits of the given type (all types if empty);
+  // returns the first violating type's result, or the one with the largest minTimescale.
+  // Without limits, any timescale is feasible (minTimescale = 0).
+  template<class Poly>
+  FeasibilityResult check(
+    const std::vector<Poly>& pieces,
+    float timescale,
+    const std::string& type = std::string()) const
+  {
+    std::vector<FeasibilityLimits> limits;
+    for (const auto& entry : m_limits) {
+      if (type.empty() || entry.first == type) {
+        limits.push_back(entry.second);
+      }
+    }
+    FeasibilityResult worst;
+    worst.violation = FeasibilityResult::None;
+    worst.time = 0;
+    worst.value = 0;
+    worst.limit = 0;
+    worst.minTimescale = 0;
+    if (limits.empty() || pieces.empty()) {
+      return worst;
+    }
+    PiecewiseBatch batch;
+    for (size_t i = 0; i < limits.size(); ++i) {
+      batch.add(pieces, timescale);
+    }
+    std::vector<FeasibilityResult> results;
+    TrajectoryFeasibility::check(batch, limits, m_sampleTime, results, limits.size());
+    worst = results[0];
+    for (const auto& result : results) {
+      if (result.feasible() == worst.feasible() ? result.minTimescale > worst.minTimescale : !result.feasible()) {
+        worst = result;
+      }
+    }
+    return worst;
+  }
+
+private:
+  std::map<std::string, FeasibilityLimits> m_limits;
+  double m_sampleTime;
+};
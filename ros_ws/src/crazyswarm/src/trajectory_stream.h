@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <crazyflie_cpp/Crazyflie.h>
+
+/*
+Streaming trajectory upload (one per CF)
+ * Trajectories longer than the CF's trajectory memory are split into segments. A region of the
+   memory is used as a ring of two slots (double buffering): while the CF executes the segment in
+   one slot, the next segment is uploaded into the other one.
+ * The firmware cannot wrap a trajectory around the end of a memory region, so each slot is
+   defined as its own trajectory id (trajectoryId and trajectoryId + 1) and the server starts
+   the next segment when the previous one ends. A start that arrives late makes the CF hold the
+   end point of the previous segment (at zero velocity), so the start command is sent early by
+   the measured one-way latency of the start commands (sendTime()).
+ * The playhead is estimated on the host (arrival time of the current segment's start plus its
+   scaled duration), so the schedule follows early and late starts. A segment is uploaded at most
+   lookahead seconds before it starts, and only once the segment that used its slot before was
+   replaced by the following one.
+ * Every late start is counted (numLateStarts(), waited()). If a segment is not uploaded by the
+   time it should start (e.g., the radio is busy), the CF holds the last setpoint of the previous
+   segment until it is.
+ * Pieces are absolute: a relative start would re-anchor every segment at the CF's position
+   at its start, accumulating the tracking error.
+*/
+
+class TrajectoryStream
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+  struct Settings
+  {
+    uint8_t trajectoryId;   // slots use trajectoryId and trajectoryId + 1
+    uint32_t regionOffset;  // first piece of the ring region
+    uint32_t regionPieces;  // size of the ring region (two slots)
+    double lookahead;       // seconds
+    float timescale;
+  };
+
+  struct Segment
+  {
+    size_t firstPiece;
+    size_t numPieces;
+    double start;     // seconds after the stream started (without delays)
+    double duration;  // seconds (scaled)
+  };
+
+  TrajectoryStream(
+    const Settings& settings,
+    const std::vector<Crazyflie::poly4d>& pieces)
+    : m_settings(settings)
+    , m_pieces(pieces)
+    , m_segments()
+    , m_start()
+    , m_delay(0)
+    , m_latency(0)
+    , m_waited(0)
+    , m_numUploaded(0)
+    , m_numStarted(0)
+    , m_numLateStarts(0)
+  {
+    size_t slotPieces = std::max<size_t>(settings.regionPieces / 2, 1);
+    double start = 0;
+    for (size_t first = 0; first < pieces.size(); first += slotPieces) {
+      Segment segment{first, std::min(slotPieces, pieces.size() - first), start, 0};
+      for (size_t i = first; i < first + segment.numPieces; ++i) {
+        segment.duration += pieces[i].duration * settings.timescale;
+      }
+      start += segment.duration;
+      m_segments.push_back(segment);
+    }
+  }
+
+  // Returns false if the settings cannot work (e.g., too small region)
+  static bool check(
+    const Settings& settings,
+    const std::vector<Crazyflie::poly4d>& pieces,
+    std::string& message)
+  {
+    if (pieces.empty()) {
+      message = "No pieces";
+      return false;
+    }
+    if (settings.regionPieces < 2) {
+      message = "Region needs at least two pieces (one per slot)";
+      return false;
+    }
+    if (settings.trajectoryId == 255) {
+      message = "Slots use trajectoryId and trajectoryId + 1";
+      return false;
+    }
+    if (settings.timescale <= 0) {
+      message = "Timescale must be positive";
+      return false;
+    }
+    return true;
+  }
+
+  size_t numSegments() const {
+    return m_segments.size();
+  }
+
+  const Segment& segment(size_t k) const {
+    return m_segments[k];
+  }
+
+  const Settings& settings() const {
+    return m_settings;
+  }
+
+  uint8_t trajectoryId(size_t k) const {
+    return m_settings.trajectoryId + k % 2;
+  }
+
+  uint32_t pieceOffset(size_t k) const {
+    return m_settings.regionOffset + (k % 2) * (m_settings.regionPieces / 2);
+  }
+
+  std::vector<Crazyflie::poly4d> pieces(size_t k) const {
+    auto begin = m_pieces.begin() + m_segments[k].firstPiece;
+    return std::vector<Crazyflie::poly4d>(begin, begin + m_segments[k].numPieces);
+  }
+
+  // Marks the stream as started (the first segment must be uploaded already),
+  // with the time the CF received the first start and the one-way latency of it
+  void begin(clock::time_point arrival, double latency)
+  {
+    m_start = arrival;
+    m_latency = latency;
+    m_numStarted = 1;
+  }
+
+  // Segment to upload now, or -1
+  int nextUpload(clock::time_point now) const
+  {
+    size_t k = m_numUploaded;
+    if (k >= m_segments.size()) {
+      return -1;
+    }
+    // the slot is in use until segment k - 1 replaced segment k - 2
+    if (k >= 2 && m_numStarted < k) {
+      return -1;
+    }
+    if (k > 0 && m_numStarted > 0 && toSeconds(startOf(k) - now) > m_settings.lookahead) {
+      return -1;
+    }
+    return k;
+  }
+
+  void uploaded(size_t k) {
+    m_numUploaded = k + 1;
+  }
+
+  // Segment to start at or before the given time (see sendTime), or -1
+  int nextStart(clock::time_point until) const
+  {
+    size_t k = m_numStarted;
+    if (k == 0 || k >= m_segments.size() || until < sendTime(k)) {
+      return -1;
+    }
+    // not uploaded yet: the CF holds its last setpoint until it is
+    return k < m_numUploaded ? k : -1;
+  }
+
+  // When to send the start of segment k, so that it arrives when segment k - 1 ends
+  clock::time_point sendTime(size_t k) const {
+    return startOf(k) - std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(m_latency));
+  }
+
+  // The start of segment k was sent at the given time and took latency seconds
+  // to arrive (e.g., half of the acknowledged round trip). The remaining schedule
+  // follows the actual start.
+  void started(size_t k, clock::time_point sent, double latency)
+  {
+    double late = toSeconds(sent - startOf(k)) + latency;
+    if (late > 0) {
+      ++m_numLateStarts;
+      m_waited += late;
+    }
+    m_delay += late;
+    m_latency = 0.8 * m_latency + 0.2 * latency;
+    m_numStarted = k + 1;
+  }
+
+  bool finished(clock::time_point now) const {
+    return m_numStarted == m_segments.size() && now >= endOf(m_segments.size() - 1);
+  }
+
+  // Seconds the CF held the end point of a segment for late starts
+  double waited() const {
+    return m_waited;
+  }
+
+  size_t numLateStarts() const {
+    return m_numLateStarts;
+  }
+
+private:
+  clock::time_point startOf(size_t k) const {
+    return m_start + std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(m_segments[k].start + m_delay));
+  }
+
+  clock::time_point endOf(size_t k) const {
+    return startOf(k) + std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(m_segments[k].duration));
+  }
+
+  static double toSeconds(clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+  }
+
+  Settings m_settings;
+  std::vector<Crazyflie::poly4d> m_pieces;
+  std::vector<Segment> m_segments;
+  clock::time_point m_start;
+  double m_delay;     // of the actual starts against the schedule (s, negative if early)
+  double m_latency;   // s, one-way, smoothed
+  double m_waited;
+  size_t m_numUploaded;
+  size_t m_numStarted;
+  size_t m_numLateStarts;
+};